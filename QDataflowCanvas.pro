@@ -1,4 +1,4 @@
-QT       += core gui widgets
+QT       += core gui widgets concurrent network
 
 CONFIG += c++11
 
@@ -7,12 +7,44 @@ TEMPLATE = app
 
 SOURCES += main.cpp\
         mainwindow.cpp \
+    qdataflowbinaryformat.cpp \
     qdataflowcanvas.cpp \
-    qdataflowmodel.cpp
+    qdataflowexecutionplan.cpp \
+    qdataflowexecutor.cpp \
+    qdataflowkernels.cpp \
+    qdataflowmessage.cpp \
+    qdataflowmodel.cpp \
+    qdataflowmodeldiff.cpp \
+    qdataflowmodelsnapshot.cpp \
+    qdataflowpipeline.cpp \
+    qdataflowreplication.cpp \
+    qdataflowscheduler.cpp \
+    qdataflowsubpatch.cpp \
+    qdataflowtextformat.cpp \
+    qdataflowtopology.cpp \
+    qdataflowtyperegistry.cpp \
+    qdataflowundojournal.cpp
 
 HEADERS  += mainwindow.h \
+    qdataflowbinaryformat.h \
     qdataflowcanvas.h \
-    qdataflowmodel.h
+    qdataflowexecutionplan.h \
+    qdataflowexecutor.h \
+    qdataflowkernels.h \
+    qdataflowmessage.h \
+    qdataflowmodel.h \
+    qdataflowmodeldiff.h \
+    qdataflowmodelsnapshot.h \
+    qdataflowpipeline.h \
+    qdataflowpool.h \
+    qdataflowreplication.h \
+    qdataflowscheduler.h \
+    qdataflowspscqueue.h \
+    qdataflowsubpatch.h \
+    qdataflowtextformat.h \
+    qdataflowtopology.h \
+    qdataflowtyperegistry.h \
+    qdataflowundojournal.h
 
 FORMS += \
     mainwindow.ui
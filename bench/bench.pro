@@ -0,0 +1,52 @@
+# Allocation benchmark (see main.cpp); builds the model sources of the
+# parent directory without the example application
+
+QT       += core gui widgets concurrent network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = qdataflowbench
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    ../qdataflowbinaryformat.cpp \
+    ../qdataflowcanvas.cpp \
+    ../qdataflowexecutionplan.cpp \
+    ../qdataflowexecutor.cpp \
+    ../qdataflowkernels.cpp \
+    ../qdataflowmessage.cpp \
+    ../qdataflowmodel.cpp \
+    ../qdataflowmodeldiff.cpp \
+    ../qdataflowmodelsnapshot.cpp \
+    ../qdataflowpipeline.cpp \
+    ../qdataflowreplication.cpp \
+    ../qdataflowscheduler.cpp \
+    ../qdataflowsubpatch.cpp \
+    ../qdataflowtextformat.cpp \
+    ../qdataflowtopology.cpp \
+    ../qdataflowtyperegistry.cpp \
+    ../qdataflowundojournal.cpp
+
+HEADERS += \
+    ../qdataflowbinaryformat.h \
+    ../qdataflowcanvas.h \
+    ../qdataflowexecutionplan.h \
+    ../qdataflowexecutor.h \
+    ../qdataflowkernels.h \
+    ../qdataflowmessage.h \
+    ../qdataflowmodel.h \
+    ../qdataflowmodeldiff.h \
+    ../qdataflowmodelsnapshot.h \
+    ../qdataflowpipeline.h \
+    ../qdataflowpool.h \
+    ../qdataflowreplication.h \
+    ../qdataflowscheduler.h \
+    ../qdataflowspscqueue.h \
+    ../qdataflowsubpatch.h \
+    ../qdataflowtextformat.h \
+    ../qdataflowtopology.h \
+    ../qdataflowtyperegistry.h \
+    ../qdataflowundojournal.h
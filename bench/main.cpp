@@ -0,0 +1,145 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+// Allocation benchmark for model nodes and connections: builds and clears
+// chains of nodes a few times, either through the pools behind
+// QDataflowModel::newNode()/newConnection() (the default), or the way
+// they were allocated before them (with --heap): on the heap, without a
+// parent, then moved to the model's thread and reparented.
+//
+//     qdataflowbench [--heap] [nodes] [rounds]
+//
+// Run each mode in its own process, as the resident set size (RSS) is
+// that of the whole process.
+
+#include "qdataflowmodel.h"
+#include "qdataflowpool.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+namespace {
+
+// one word larger than the pooled classes, so that the pools forward them
+// to the global heap
+class HeapNode : public QDataflowModelNode
+{
+public:
+    HeapNode(QDataflowModel *parent, QPoint pos, QString text, int inletCount, int outletCount)
+        : QDataflowModelNode(parent, pos, text, inletCount, outletCount), padding_(0L) {}
+
+private:
+    void *padding_;
+};
+
+class HeapConnection : public QDataflowModelConnection
+{
+public:
+    HeapConnection(QDataflowModel *parent, const QDataflowModelOutlet &source, const QDataflowModelInlet &dest)
+        : QDataflowModelConnection(parent, source, dest), padding_(0L) {}
+
+private:
+    void *padding_;
+};
+
+class HeapModel : public QDataflowModel
+{
+public:
+    QDataflowModelNode * newNode(QPoint pos, QString text, int inletCount, int outletCount)
+    {
+        QDataflowModelNode *node = new HeapNode(0L, pos, text, inletCount, outletCount);
+        node->moveToThread(thread());
+        node->setParent(this);
+        return node;
+    }
+
+    QDataflowModelConnection * newConnection(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet)
+    {
+        QDataflowModelConnection *conn = new HeapConnection(0L, sourceNode->outlet(sourceOutlet), destNode->inlet(destInlet));
+        conn->moveToThread(thread());
+        conn->setParent(this);
+        return conn;
+    }
+};
+
+// resident set size in KiB, or -1 where /proc is not available
+qint64 residentKiB()
+{
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if(!statm.open(QIODevice::ReadOnly)) return -1;
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if(fields.size() < 2) return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return -1;
+#endif
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    args.removeFirst();
+    const bool heap = args.removeAll("--heap") > 0;
+    const int nodes = qMax(2, args.value(0, "100000").toInt());
+    const int rounds = qMax(1, args.value(1, "5").toInt());
+
+    QDataflowModel *model = heap ? new HeapModel : new QDataflowModel;
+    QTextStream out(stdout);
+    out << (heap ? "heap" : "pool") << ": " << nodes << " nodes, " << (nodes - 1) << " connections, "
+        << rounds << " rounds\n";
+    out << "start: RSS " << residentKiB() << " KiB\n";
+
+    for(int round = 0; round < rounds; round++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        model->beginUpdate();
+        QDataflowModelNode *previous = 0L;
+        for(int i = 0; i < nodes; i++)
+        {
+            QDataflowModelNode *node = model->create(QPoint(i % 1000 * 10, i / 1000 * 10), "node", 1, 1);
+            if(previous) model->connect(previous, 0, node, 0);
+            previous = node;
+        }
+        model->endUpdate();
+        const qint64 buildMs = timer.restart();
+        const qint64 builtKiB = residentKiB();
+
+        model->clear();
+        const qint64 clearMs = timer.elapsed();
+
+        out << "round " << round << ": build " << buildMs << " ms, clear " << clearMs << " ms, RSS "
+            << builtKiB << " KiB built, " << residentKiB() << " KiB cleared\n";
+        out.flush();
+    }
+
+    delete model;
+    out << "end: RSS " << residentKiB() << " KiB, pooled bytes "
+        << (QDataflowPool<QDataflowModelNode>::instance().reservedBytes() +
+            QDataflowPool<QDataflowModelConnection>::instance().reservedBytes()) << "\n";
+    return 0;
+}
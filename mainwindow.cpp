@@ -15,9 +15,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "mainwindow.h"
+#include "qdataflowbinaryformat.h"
+#include "qdataflowexecutor.h"
+#include "qdataflowkernels.h"
+#include "qdataflowpool.h"
+#include "qdataflowsubpatch.h"
+#include "qdataflowtextformat.h"
+#include "qdataflowundojournal.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <QMenu>
+#include <QFileDialog>
+#include <QMessageBox>
 #include <QDebug>
 
 class DFSource : public QDataflowMetaObject
@@ -40,37 +49,59 @@ public:
         : QDataflowMetaObject(node)
     {
         s = 0;
+        blockS = 0;
 
         setInletTypes({"int", "int"});
         setOutletTypes({"int"});
 
         op = args[0];
+        kernelOp = QDataflowKernels::Add;
+        QDataflowKernels::opFromName(op, &kernelOp);
 
         if(args.length() > 1)
-            s = args[1].toLong();
+            blockS = s = args[1].toLong();
     }
 
-    void onDataReceved(int inlet, void *data)
+    void onDataReceved(int inlet, const QDataflowMessage &message)
     {
         if(inlet == 0)
         {
-            int r = reinterpret_cast<long>(data);
+            int r = message.toInt();
             if(op == "add") r = r + s;
             if(op == "sub") r = r - s;
             if(op == "mul") r = r * s;
             if(op == "div") r = r / s;
             if(op == "pow") r = pow(r, s);
-            sendData(0, reinterpret_cast<void*>(r));
+            sendData(0, r);
         }
         else if(inlet == 1)
         {
-            s = reinterpret_cast<long>(data);
+            blockS = s = message.toInt();
+        }
+    }
+
+    // blocks are computed in float, so the right operand is kept in float
+    // too; the int one (used for single values) gets it rounded
+    void processBlock(int inlet, const float *samples, int n)
+    {
+        if(inlet == 0)
+        {
+            QVector<float> r(n);
+            QDataflowKernels::apply(kernelOp, samples, blockS, r.data(), n);
+            sendData(0, std::move(r));
+        }
+        else if(inlet == 1 && n > 0)
+        {
+            blockS = samples[n - 1];
+            s = qRound(blockS);
         }
     }
 
 private:
     QString op;
+    QDataflowKernels::Op kernelOp;
     int s;
+    float blockS;
 };
 
 class DFNum2Str : public QDataflowMetaObject
@@ -85,12 +116,11 @@ public:
         setOutletTypes({"string"});
     }
 
-    void onDataReceved(int inlet, void *data)
+    void onDataReceved(int inlet, const QDataflowMessage &message)
     {
         Q_UNUSED(inlet);
 
-        QString s = QString::number(reinterpret_cast<long>(data));
-        sendData(0, reinterpret_cast<void*>(&s));
+        sendData(0, QString::number(message.toInt()));
     }
 };
 
@@ -106,11 +136,12 @@ public:
         //setOutletCount(0);
     }
 
-    void onDataReceved(int inlet, void *data)
+    void onDataReceved(int inlet, const QDataflowMessage &message)
     {
         if(inlet == 0)
         {
-            e_->setText(*reinterpret_cast<QString*>(data));
+            // may be called from a worker thread of QDataflowExecutor
+            QMetaObject::invokeMethod(e_, "setText", Qt::AutoConnection, Q_ARG(QString, message.toString()));
         }
     }
 
@@ -119,23 +150,26 @@ private:
 };
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent)
+    : QMainWindow(parent), sourceNode(0L)
 {
     setupUi(this);
 
     QMenu *modelMenu = menuBar()->addMenu(tr("&Model"));
+    modelMenu->addAction("Open...", this, &MainWindow::onOpenModel);
+    modelMenu->addAction("Save as...", this, &MainWindow::onSaveModel);
     modelMenu->addAction("Dump to console", this, &MainWindow::onDumpModel);
+    QAction *executorAction = modelMenu->addAction("Run on worker threads", this, &MainWindow::onToggleExecutor);
+    executorAction->setCheckable(true);
 
-    classList << "add" << "sub" << "mul" << "div" << "pow" << "source" << "sink" << "num2str";
+    classList << "add" << "sub" << "mul" << "div" << "pow" << "source" << "sink" << "num2str" << "pd" << "inlet" << "outlet";
     canvas->setCompletion(this);
 
     QDataflowModel *model = canvas->model();
 
     new QDataflowModelDebugSignals(model);
+    setupModel(model);
 
     QObject::connect(sendButton, &QPushButton::clicked, this, &MainWindow::processData);
-    QObject::connect(model, &QDataflowModel::nodeTextChanged, this, &MainWindow::onNodeTextChanged);
-    QObject::connect(model, &QDataflowModel::nodeAdded, this, &MainWindow::onNodeAdded);
 
     // set up a small dataflow graph:
     QDataflowModelNode *source = model->create(QPoint(100, 10), "source", 0, 0);
@@ -159,8 +193,22 @@ void MainWindow::complete(QString txt, QStringList &completionList)
             completionList << className;
 }
 
+void MainWindow::setupModel(QDataflowModel *model)
+{
+    new QDataflowUndoJournal(model);
+
+    QObject::connect(model, &QDataflowModel::nodeTextChanged, this, &MainWindow::onNodeTextChanged);
+    QObject::connect(model, &QDataflowModel::nodeAdded, this, &MainWindow::onNodeAdded);
+    QObject::connect(model, &QDataflowModel::nodesAdded, this, &MainWindow::onNodesAdded);
+    QObject::connect(model, &QDataflowModel::nodeRemoved, this, &MainWindow::onNodeRemoved);
+    QObject::connect(model, &QDataflowModel::nodesRemoved, this, &MainWindow::onNodesRemoved);
+    // nested models of subpatches are set up the same way, when loaded
+    QObject::connect(model, &QDataflowModel::subpatchLoaded, this, &MainWindow::onSubpatchLoaded);
+}
+
 void MainWindow::setupNode(QDataflowModelNode *node)
 {
+    if(sourceNode == node) sourceNode = 0L;
     QStringList toks = node->text().split(QRegExp("(\\ |\\t)"));
     if(!classList.contains(toks[0]))
     {
@@ -170,14 +218,18 @@ void MainWindow::setupNode(QDataflowModelNode *node)
     if(toks[0] == "source") {sourceNode = node; node->setDataflowMetaObject(new DFSource(node, toks));}
     else if(toks[0] == "sink") node->setDataflowMetaObject(new DFSink(node, toks, result));
     else if(toks[0] == "num2str") node->setDataflowMetaObject(new DFNum2Str(node, toks));
+    else if(toks[0] == "pd") node->setDataflowMetaObject(new QDataflowSubpatchMetaObject(node));
+    else if(toks[0] == "inlet") node->setDataflowMetaObject(new QDataflowInletProxyMetaObject(node, toks));
+    else if(toks[0] == "outlet") node->setDataflowMetaObject(new QDataflowOutletProxyMetaObject(node, toks));
     else node->setDataflowMetaObject(new DFMathBinOp(node, toks));
     node->setValid(true);
 }
 
 void MainWindow::processData()
 {
-    long x = input->value();
-    sourceNode->dataflowMetaObject()->sendData(0, reinterpret_cast<void*>(x));
+    if(!sourceNode) return;
+    int x = input->value();
+    sourceNode->dataflowMetaObject()->sendData(0, x);
 }
 
 void MainWindow::onNodeAdded(QDataflowModelNode *node)
@@ -185,22 +237,103 @@ void MainWindow::onNodeAdded(QDataflowModelNode *node)
     setupNode(node);
 }
 
+void MainWindow::onNodesAdded(QList<QDataflowModelNode*> nodes)
+{
+    foreach(QDataflowModelNode *node, nodes)
+        setupNode(node);
+}
+
+void MainWindow::onNodeRemoved(QDataflowModelNode *node)
+{
+    // the node will be deleted as soon as control returns to the event loop
+    if(sourceNode == node) sourceNode = 0L;
+}
+
+void MainWindow::onNodesRemoved(QList<QDataflowModelNode*> nodes)
+{
+    foreach(QDataflowModelNode *node, nodes)
+        onNodeRemoved(node);
+}
+
 void MainWindow::onNodeTextChanged(QDataflowModelNode *node, QString text)
 {
     Q_UNUSED(text);
     setupNode(node);
 }
 
+void MainWindow::onSubpatchLoaded(QDataflowModelNode *node, QDataflowModel *subpatchModel)
+{
+    Q_UNUSED(node);
+    setupModel(subpatchModel);
+}
+
+void MainWindow::onOpenModel()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open patch"), QString(), tr("Text patches (*.qdf);;Binary patches (*.qdfp)"));
+    if(fileName.isEmpty()) return;
+    QDataflowModel *model = canvas->model();
+    model->clear();
+    bool ok;
+    if(fileName.endsWith(".qdfp"))
+    {
+        ok = QDataflowBinaryFormat::load(model, fileName);
+        if(ok)
+            statusbar->showMessage(tr("Loaded %1 nodes and %2 connections").arg(model->nodeCount()).arg(model->connectionCount()));
+    }
+    else
+    {
+        QDataflowTextFormat::Statistics stats;
+        ok = QDataflowTextFormat::load(model, fileName, &stats);
+        if(ok)
+            statusbar->showMessage(tr("Loaded %1 nodes and %2 connections (%3 errors)").arg(stats.nodes).arg(stats.connections).arg(stats.errors));
+    }
+    if(!ok)
+        QMessageBox::warning(this, tr("Open patch"), tr("Could not load %1").arg(fileName));
+}
+
+void MainWindow::onSaveModel()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save patch"), QString(), tr("Text patches (*.qdf);;Binary patches (*.qdfp)"));
+    if(fileName.isEmpty()) return;
+    bool ok;
+    if(fileName.endsWith(".qdfp"))
+        ok = QDataflowBinaryFormat::save(canvas->model(), fileName);
+    else
+        ok = QDataflowTextFormat::save(canvas->model(), fileName);
+    if(!ok)
+        QMessageBox::warning(this, tr("Save patch"), tr("Could not save %1").arg(fileName));
+}
+
+void MainWindow::onToggleExecutor(bool enabled)
+{
+    QDataflowModel *model = canvas->model();
+    if(enabled)
+        new QDataflowExecutor(model);
+    else
+        delete model->executor();
+}
+
 void MainWindow::onDumpModel()
 {
     QDataflowModel *model = canvas->model();
 
-    foreach(QDataflowModelNode *node, model->nodes())
+    foreach(QDataflowModelNode *node, model->nodeRange())
     {
         qDebug() << "DUMP: node: " << node;
     }
-    foreach(QDataflowModelConnection *conn, model->connections())
+    foreach(QDataflowModelConnection *conn, model->connectionRange())
     {
         qDebug() << "DUMP: connection: " << conn;
     }
+    qDebug() << "DUMP: node pool:" << QDataflowPool<QDataflowModelNode>::instance().liveCount() << "live,"
+             << QDataflowPool<QDataflowModelNode>::instance().reservedBytes() << "bytes reserved";
+    qDebug() << "DUMP: connection pool:" << QDataflowPool<QDataflowModelConnection>::instance().liveCount() << "live,"
+             << QDataflowPool<QDataflowModelConnection>::instance().reservedBytes() << "bytes reserved";
+    qDebug() << "DUMP: canvas items:" << canvas->itemCount();
+    if(QDataflowExecutor *executor = model->executor())
+        qDebug() << "DUMP: executor:" << executor->threadCount() << "threads,"
+                 << executor->deliveredCount() << "messages delivered," << executor->stealCount() << "steals";
+    if(QDataflowUndoJournal *journal = model->undoJournal())
+        qDebug() << "DUMP: undo journal:" << journal->index() << "/" << journal->count() << "commands,"
+                 << journal->memoryUsage() << "bytes";
 }
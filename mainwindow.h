@@ -20,6 +20,8 @@
 #include "ui_mainwindow.h"
 #include "qdataflowcanvas.h"
 
+#include <QPointer>
+
 class MainWindow : public QMainWindow, private Ui::MainWindow, public QDataflowTextCompletion
 {
     Q_OBJECT
@@ -31,14 +33,23 @@ public:
     void complete(QString txt, QStringList &completionList) override;
 
 private:
-    QDataflowModelNode *sourceNode;
+    // may be in a subpatch, which is deleted when unloaded
+    QPointer<QDataflowModelNode> sourceNode;
     QStringList classList;
 
 private slots:
+    void setupModel(QDataflowModel *model);
     void setupNode(QDataflowModelNode *node);
     void processData();
     void onNodeAdded(QDataflowModelNode *node);
+    void onNodesAdded(QList<QDataflowModelNode*> nodes);
+    void onNodeRemoved(QDataflowModelNode *node);
+    void onNodesRemoved(QList<QDataflowModelNode*> nodes);
     void onNodeTextChanged(QDataflowModelNode *node, QString text);
+    void onSubpatchLoaded(QDataflowModelNode *node, QDataflowModel *subpatchModel);
+    void onOpenModel();
+    void onSaveModel();
+    void onToggleExecutor(bool enabled);
     void onDumpModel();
 };
 
@@ -0,0 +1,409 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowbinaryformat.h"
+#include "qdataflowmodel.h"
+#include "qdataflowsubpatch.h"
+#include "qdataflowtyperegistry.h"
+
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QSaveFile>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+const char magic[4] = {'Q', 'D', 'F', 'P'};
+
+enum
+{
+    HeaderSize = 32,
+    StringEntrySize = 8,
+    NodeRecordSize = 24,
+    PortRecordSize = 4,
+    ConnectionRecordSize = 16,
+    SubpatchRecordSize = 8
+};
+
+void putU16(uchar *&p, quint16 v)
+{
+    qToLittleEndian(v, p);
+    p += 2;
+}
+
+void putU32(uchar *&p, quint32 v)
+{
+    qToLittleEndian(v, p);
+    p += 4;
+}
+
+quint16 getU16(const uchar *&p)
+{
+    quint16 v = qFromLittleEndian<quint16>(p);
+    p += 2;
+    return v;
+}
+
+quint32 getU32(const uchar *&p)
+{
+    quint32 v = qFromLittleEndian<quint32>(p);
+    p += 4;
+    return v;
+}
+
+class StringTable
+{
+public:
+    quint32 add(const QString &s)
+    {
+        QHash<QString, quint32>::const_iterator it = index_.constFind(s);
+        if(it != index_.constEnd()) return it.value();
+        quint32 i = strings_.size();
+        index_.insert(s, i);
+        strings_.push_back(s.toUtf8());
+        return i;
+    }
+
+    const QVector<QByteArray> & strings() const {return strings_;}
+
+private:
+    QHash<QString, quint32> index_;
+    QVector<QByteArray> strings_;
+};
+
+}
+
+QByteArray QDataflowBinaryFormat::toByteArray(const QDataflowModel *model)
+{
+    StringTable strings;
+    QHash<int, quint32> typeStrings;
+    QDataflowTypeRegistry *registry = QDataflowTypeRegistry::instance();
+
+    // first pass: collect strings, and number nodes and ports
+    QVector<int> nodeIndex(model->nodeIdBound(), -1);
+    QVector<quint32> nodeText;
+    QVector<quint32> ports;
+    QVector<QPair<quint32, quint32> > subpatches;
+    nodeText.reserve(model->nodeCount());
+    foreach(QDataflowModelNode *node, model->nodeRange())
+    {
+        nodeIndex[node->id()] = nodeText.size();
+        nodeText.push_back(strings.add(node->text()));
+        if(node->subpatch())
+            subpatches.push_back(qMakePair(quint32(nodeIndex[node->id()]), strings.add(QString::fromUtf8(node->subpatch()->contents()))));
+        for(int i = 0; i < node->inletCount() + node->outletCount(); i++)
+        {
+            int type = i < node->inletCount() ? node->inlets_.at(i).type : node->outlets_.at(i - node->inletCount()).type;
+            if(!typeStrings.contains(type))
+                typeStrings.insert(type, strings.add(registry->name(type)));
+            ports.push_back(typeStrings.value(type));
+        }
+    }
+
+    quint32 stringDataSize = 0;
+    foreach(const QByteArray &s, strings.strings())
+        stringDataSize += s.size();
+    stringDataSize = (stringDataSize + 3) & ~3u;
+
+    const quint32 stringCount = strings.strings().size();
+    const quint32 nodeCount = nodeText.size();
+    const quint32 connectionCount = model->connectionCount();
+    QByteArray ret(HeaderSize + stringCount * StringEntrySize + stringDataSize +
+                   nodeCount * NodeRecordSize + ports.size() * PortRecordSize +
+                   connectionCount * ConnectionRecordSize + subpatches.size() * SubpatchRecordSize, '\0');
+    uchar *p = reinterpret_cast<uchar*>(ret.data());
+
+    memcpy(p, magic, 4);
+    p += 4;
+    putU32(p, Version);
+    putU32(p, stringCount);
+    putU32(p, stringDataSize);
+    putU32(p, nodeCount);
+    putU32(p, ports.size());
+    putU32(p, connectionCount);
+    putU32(p, subpatches.size());
+
+    quint32 offset = 0;
+    foreach(const QByteArray &s, strings.strings())
+    {
+        putU32(p, offset);
+        putU32(p, s.size());
+        offset += s.size();
+    }
+    foreach(const QByteArray &s, strings.strings())
+    {
+        memcpy(p, s.constData(), s.size());
+        p += s.size();
+    }
+    p += stringDataSize - offset;
+
+    quint32 firstPort = 0;
+    foreach(QDataflowModelNode *node, model->nodeRange())
+    {
+        putU32(p, node->id());
+        putU32(p, node->pos().x());
+        putU32(p, node->pos().y());
+        putU32(p, nodeText.at(nodeIndex.at(node->id())));
+        putU16(p, node->inletCount());
+        putU16(p, node->outletCount());
+        putU32(p, firstPort);
+        firstPort += node->inletCount() + node->outletCount();
+    }
+
+    foreach(quint32 type, ports)
+        putU32(p, type);
+
+    foreach(QDataflowModelConnection *conn, model->connectionRange())
+    {
+        putU32(p, nodeIndex.at(conn->source().node()->id()));
+        putU32(p, conn->source().index());
+        putU32(p, nodeIndex.at(conn->dest().node()->id()));
+        putU32(p, conn->dest().index());
+    }
+
+    for(int i = 0; i < subpatches.size(); i++)
+    {
+        putU32(p, subpatches.at(i).first);
+        putU32(p, subpatches.at(i).second);
+    }
+
+    return ret;
+}
+
+bool QDataflowBinaryFormat::save(const QDataflowModel *model, QIODevice *device)
+{
+    QByteArray data = toByteArray(model);
+    if(device->write(data) != data.size())
+    {
+        qDebug() << "failed to write patch:" << device->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool QDataflowBinaryFormat::save(const QDataflowModel *model, const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "failed to open" << fileName << "for writing:" << file.errorString();
+        return false;
+    }
+    if(!save(model, &file))
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool QDataflowBinaryFormat::load(QDataflowModel *model, const uchar *data, qint64 size)
+{
+    if(size < HeaderSize || memcmp(data, magic, 4) != 0)
+    {
+        qDebug() << "not a binary patch";
+        return false;
+    }
+
+    const uchar *p = data + 4;
+    const quint32 version = getU32(p);
+    const quint32 stringCount = getU32(p);
+    const quint32 stringDataSize = getU32(p);
+    const quint32 nodeCount = getU32(p);
+    const quint32 portCount = getU32(p);
+    const quint32 connectionCount = getU32(p);
+    // reserved (and zero) in version 1
+    const quint32 subpatchCount = version >= 2 ? getU32(p) : 0;
+    if(version < 1 || version > Version)
+    {
+        qDebug() << "unsupported binary patch version" << version;
+        return false;
+    }
+
+    const quint64 expectedSize = quint64(HeaderSize) + quint64(stringCount) * StringEntrySize + stringDataSize +
+            quint64(nodeCount) * NodeRecordSize + quint64(portCount) * PortRecordSize +
+            quint64(connectionCount) * ConnectionRecordSize + quint64(subpatchCount) * SubpatchRecordSize;
+    if(quint64(size) != expectedSize)
+    {
+        qDebug() << "truncated or corrupted binary patch";
+        return false;
+    }
+
+    const uchar *stringEntries = data + HeaderSize;
+    const uchar *stringData = stringEntries + quint64(stringCount) * StringEntrySize;
+    const uchar *nodeRecords = stringData + stringDataSize;
+    const uchar *portRecords = nodeRecords + quint64(nodeCount) * NodeRecordSize;
+    const uchar *connectionRecords = portRecords + quint64(portCount) * PortRecordSize;
+    const uchar *subpatchRecords = connectionRecords + quint64(connectionCount) * ConnectionRecordSize;
+
+    // validate everything before touching the model:
+    p = stringEntries;
+    for(quint32 i = 0; i < stringCount; i++)
+    {
+        quint64 offset = getU32(p), length = getU32(p);
+        if(offset + length > stringDataSize)
+        {
+            qDebug() << "corrupted string table entry" << i;
+            return false;
+        }
+    }
+    QVector<quint16> inletCounts(nodeCount), outletCounts(nodeCount);
+    p = nodeRecords;
+    for(quint32 i = 0; i < nodeCount; i++)
+    {
+        p += 12;
+        quint32 text = getU32(p);
+        inletCounts[i] = getU16(p);
+        outletCounts[i] = getU16(p);
+        quint64 firstPort = getU32(p);
+        if(text >= stringCount || firstPort + inletCounts[i] + outletCounts[i] > portCount)
+        {
+            qDebug() << "corrupted node record" << i;
+            return false;
+        }
+    }
+    p = portRecords;
+    for(quint32 i = 0; i < portCount; i++)
+    {
+        if(getU32(p) >= stringCount)
+        {
+            qDebug() << "corrupted port record" << i;
+            return false;
+        }
+    }
+    p = connectionRecords;
+    for(quint32 i = 0; i < connectionCount; i++)
+    {
+        quint32 sourceNode = getU32(p);
+        quint32 sourceOutlet = getU32(p);
+        quint32 destNode = getU32(p);
+        quint32 destInlet = getU32(p);
+        if(sourceNode >= nodeCount || destNode >= nodeCount ||
+                sourceOutlet >= outletCounts.at(sourceNode) || destInlet >= inletCounts.at(destNode))
+        {
+            qDebug() << "corrupted connection record" << i;
+            return false;
+        }
+    }
+    p = subpatchRecords;
+    for(quint32 i = 0; i < subpatchCount; i++)
+    {
+        quint32 node = getU32(p);
+        quint32 contents = getU32(p);
+        if(node >= nodeCount || contents >= stringCount)
+        {
+            qDebug() << "corrupted subpatch record" << i;
+            return false;
+        }
+    }
+
+    // strings are decoded once, and types interned once:
+    QVector<QString> strings(stringCount);
+    QVector<int> types(stringCount, -1);
+    p = stringEntries;
+    for(quint32 i = 0; i < stringCount; i++)
+    {
+        quint32 offset = getU32(p), length = getU32(p);
+        strings[i] = QString::fromUtf8(reinterpret_cast<const char*>(stringData + offset), length);
+    }
+    QDataflowTypeRegistry *registry = QDataflowTypeRegistry::instance();
+
+    // everything has been validated: the model is built in bulk, without
+    // per-item checks, reordering or notifications
+    model->beginBulkInsert();
+    model->reserve(nodeCount, connectionCount);
+
+    QVector<QDataflowModelNode*> nodes(nodeCount);
+    QVector<int> inletTypes, outletTypes;
+    p = nodeRecords;
+    for(quint32 i = 0; i < nodeCount; i++)
+    {
+        getU32(p);
+        qint32 x = getU32(p);
+        qint32 y = getU32(p);
+        quint32 text = getU32(p);
+        int inletCount = getU16(p);
+        int outletCount = getU16(p);
+        const uchar *port = portRecords + quint64(getU32(p)) * PortRecordSize;
+
+        inletTypes.resize(inletCount);
+        outletTypes.resize(outletCount);
+        for(int j = 0; j < inletCount + outletCount; j++)
+        {
+            quint32 type = getU32(port);
+            if(types.at(type) == -1)
+                types[type] = registry->intern(strings.at(type));
+            if(j < inletCount)
+                inletTypes[j] = types.at(type);
+            else
+                outletTypes[j - inletCount] = types.at(type);
+        }
+        nodes[i] = model->appendNode(QPoint(x, y), strings.at(text), inletTypes, outletTypes);
+    }
+
+    p = connectionRecords;
+    for(quint32 i = 0; i < connectionCount; i++)
+    {
+        QDataflowModelNode *sourceNode = nodes.at(getU32(p));
+        int sourceOutlet = getU32(p);
+        QDataflowModelNode *destNode = nodes.at(getU32(p));
+        int destInlet = getU32(p);
+        if(!model->appendConnection(sourceNode, sourceOutlet, destNode, destInlet))
+            qDebug() << "skipped duplicate or incompatible connection record" << i;
+    }
+
+    // the contents stay serialized until the subpatch is loaded
+    p = subpatchRecords;
+    for(quint32 i = 0; i < subpatchCount; i++)
+    {
+        QDataflowModelNode *node = nodes.at(getU32(p));
+        node->makeSubpatch()->setContents(strings.at(getU32(p)).toUtf8());
+    }
+
+    model->endBulkInsert();
+
+    return true;
+}
+
+bool QDataflowBinaryFormat::load(QDataflowModel *model, const QByteArray &data)
+{
+    return load(model, reinterpret_cast<const uchar*>(data.constData()), data.size());
+}
+
+bool QDataflowBinaryFormat::load(QDataflowModel *model, const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "failed to open" << fileName << "for reading:" << file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if(uchar *data = file.map(0, size))
+    {
+        bool ok = load(model, data, size);
+        file.unmap(data);
+        return ok;
+    }
+
+    // mapping is not supported (or the file is empty):
+    return load(model, file.readAll());
+}
@@ -0,0 +1,63 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWBINARYFORMAT_H
+#define QDATAFLOWBINARYFORMAT_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+
+class QDataflowModel;
+
+// Binary patch format (all integers are little endian):
+//
+//   header:      char magic[4] = "QDFP", u32 version, u32 stringCount,
+//                u32 stringDataSize, u32 nodeCount, u32 portCount,
+//                u32 connectionCount, u32 subpatchCount
+//   strings:     stringCount x {u32 offset, u32 size}, followed by
+//                stringDataSize bytes of UTF-8 data (padded to 4 bytes)
+//   nodes:       nodeCount x {u32 id, i32 x, i32 y, u32 text,
+//                u16 inletCount, u16 outletCount, u32 firstPort}
+//   ports:       portCount x {u32 type}, for each node its inlets followed
+//                by its outlets, starting at firstPort
+//   connections: connectionCount x {u32 sourceNode, u32 sourceOutlet,
+//                u32 destNode, u32 destInlet}
+//   subpatches:  subpatchCount x {u32 node, u32 contents}
+//
+// Node texts, port types and subpatch contents (in the text format, see
+// QDataflowTextFormat) are indices in the string table; connections and
+// subpatches refer to nodes by their index in the node array. Version 1
+// files have no subpatches (and 0 in place of subpatchCount). Files are loaded by
+// memory-mapping them, validated, and then added to the model in bulk
+// (see QDataflowModel::beginBulkInsert()).
+class QDataflowBinaryFormat
+{
+public:
+    enum {Version = 2};
+
+    static QByteArray toByteArray(const QDataflowModel *model);
+    static bool save(const QDataflowModel *model, QIODevice *device);
+    static bool save(const QDataflowModel *model, const QString &fileName);
+
+    // the contents are added to the model (call QDataflowModel::clear()
+    // first to replace them); nothing is added if the data is not valid
+    static bool load(QDataflowModel *model, const uchar *data, qint64 size);
+    static bool load(QDataflowModel *model, const QByteArray &data);
+    static bool load(QDataflowModel *model, const QString &fileName);
+};
+
+#endif // QDATAFLOWBINARYFORMAT_H
@@ -15,6 +15,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "qdataflowcanvas.h"
+#include "qdataflowtextformat.h"
+#include "qdataflowundojournal.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -27,10 +29,13 @@
 #include <QPainter>
 #include <QStyleOption>
 #include <QApplication>
+#include <QClipboard>
+#include <QMimeData>
 #include <QTextDocument>
+#include <QTimer>
 
 QDataflowCanvas::QDataflowCanvas(QWidget *parent)
-    : QGraphicsView(parent), model_(0L)
+    : QGraphicsView(parent), model_(0L), pasteCount_(0)
 {
     QGraphicsScene *scene = new QGraphicsScene(this);
     scene->setItemIndexMethod(QGraphicsScene::NoIndex);
@@ -58,6 +63,15 @@ QDataflowCanvas::QDataflowCanvas(QWidget *parent)
 
 QDataflowCanvas::~QDataflowCanvas()
 {
+    if(subpatch_)
+    {
+        QObject::disconnect(subpatch_, 0, this, 0);
+        subpatch_->release();
+    }
+
+    // removed items are in ownedNodes_/ownedConnections_ until deleted
+    removedItems_.clear();
+
     foreach(QDataflowNode *node, ownedNodes_)
     {
         delete node;
@@ -85,13 +99,38 @@ void QDataflowCanvas::setModel(QDataflowModel *model)
         QObject::disconnect(model_, &QDataflowModel::nodeTextChanged, this, &QDataflowCanvas::onNodeTextChanged);
         QObject::disconnect(model_, &QDataflowModel::nodeInletCountChanged, this, &QDataflowCanvas::onNodeInletCountChanged);
         QObject::disconnect(model_, &QDataflowModel::nodeOutletCountChanged, this, &QDataflowCanvas::onNodeOutletCountChanged);
+        QObject::disconnect(model_, &QDataflowModel::nodeInletTypeChanged, this, &QDataflowCanvas::onNodeInletTypeChanged);
+        QObject::disconnect(model_, &QDataflowModel::nodeOutletTypeChanged, this, &QDataflowCanvas::onNodeOutletTypeChanged);
         QObject::disconnect(model_, &QDataflowModel::connectionAdded, this, &QDataflowCanvas::onConnectionAdded);
         QObject::disconnect(model_, &QDataflowModel::connectionRemoved, this, &QDataflowCanvas::onConnectionRemoved);
-        model_->deleteLater();
+        QObject::disconnect(model_, &QDataflowModel::nodesAdded, this, &QDataflowCanvas::onNodesAdded);
+        QObject::disconnect(model_, &QDataflowModel::nodesRemoved, this, &QDataflowCanvas::onNodesRemoved);
+        QObject::disconnect(model_, &QDataflowModel::connectionsAdded, this, &QDataflowCanvas::onConnectionsAdded);
+        QObject::disconnect(model_, &QDataflowModel::connectionsRemoved, this, &QDataflowCanvas::onConnectionsRemoved);
+        if(model_->parent() == this)
+            model_->deleteLater();
+
+        // item lookup is by model ID, which is only meaningful within a model:
+        foreach(QDataflowConnection *conn, connections_)
+        {
+            if(!conn) continue;
+            conn->detach();
+            scene()->removeItem(conn);
+            deleteItemLater(conn);
+        }
+        foreach(QDataflowNode *node, nodes_)
+        {
+            if(!node) continue;
+            scene()->removeItem(node);
+            deleteItemLater(node);
+        }
+        connections_.clear();
+        nodes_.clear();
     }
 
     model_ = model;
-    model_->setParent(this);
+    if(!model_->parent())
+        model_->setParent(this);
     QObject::connect(model_, &QDataflowModel::nodeAdded, this, &QDataflowCanvas::onNodeAdded);
     QObject::connect(model_, &QDataflowModel::nodeRemoved, this, &QDataflowCanvas::onNodeRemoved);
     QObject::connect(model_, &QDataflowModel::nodeValidChanged, this, &QDataflowCanvas::onNodeValidChanged);
@@ -99,8 +138,14 @@ void QDataflowCanvas::setModel(QDataflowModel *model)
     QObject::connect(model_, &QDataflowModel::nodeTextChanged, this, &QDataflowCanvas::onNodeTextChanged);
     QObject::connect(model_, &QDataflowModel::nodeInletCountChanged, this, &QDataflowCanvas::onNodeInletCountChanged);
     QObject::connect(model_, &QDataflowModel::nodeOutletCountChanged, this, &QDataflowCanvas::onNodeOutletCountChanged);
+    QObject::connect(model_, &QDataflowModel::nodeInletTypeChanged, this, &QDataflowCanvas::onNodeInletTypeChanged);
+    QObject::connect(model_, &QDataflowModel::nodeOutletTypeChanged, this, &QDataflowCanvas::onNodeOutletTypeChanged);
     QObject::connect(model_, &QDataflowModel::connectionAdded, this, &QDataflowCanvas::onConnectionAdded);
     QObject::connect(model_, &QDataflowModel::connectionRemoved, this, &QDataflowCanvas::onConnectionRemoved);
+    QObject::connect(model_, &QDataflowModel::nodesAdded, this, &QDataflowCanvas::onNodesAdded);
+    QObject::connect(model_, &QDataflowModel::nodesRemoved, this, &QDataflowCanvas::onNodesRemoved);
+    QObject::connect(model_, &QDataflowModel::connectionsAdded, this, &QDataflowCanvas::onConnectionsAdded);
+    QObject::connect(model_, &QDataflowModel::connectionsRemoved, this, &QDataflowCanvas::onConnectionsRemoved);
 }
 
 QList<QDataflowNode*> QDataflowCanvas::selectedNodes()
@@ -108,7 +153,7 @@ QList<QDataflowNode*> QDataflowCanvas::selectedNodes()
     QList<QDataflowNode*> ret;
     foreach(QDataflowNode *node, nodes_)
     {
-        if(node->scene() == scene() && node->isSelected())
+        if(node && node->scene() == scene() && node->isSelected())
             ret.push_back(node);
     }
     return ret;
@@ -119,7 +164,7 @@ QList<QDataflowConnection*> QDataflowCanvas::selectedConnections()
     QList<QDataflowConnection*> ret;
     foreach(QDataflowConnection *conn, connections_)
     {
-        if(conn->scene() == scene() && conn->isSelected())
+        if(conn && conn->scene() == scene() && conn->isSelected())
             ret.push_back(conn);
     }
     return ret;
@@ -129,7 +174,7 @@ bool QDataflowCanvas::isSomeNodeInEditMode()
 {
     foreach(QDataflowNode *node, nodes_)
     {
-        if(node->scene() == scene() && node->isInEditMode())
+        if(node && node->scene() == scene() && node->isInEditMode())
             return true;
     }
     return false;
@@ -137,24 +182,24 @@ bool QDataflowCanvas::isSomeNodeInEditMode()
 
 QDataflowNode * QDataflowCanvas::node(QDataflowModelNode *node)
 {
-    QMap<QDataflowModelNode*, QDataflowNode*>::Iterator it = nodes_.find(node);
-    if(it == nodes_.end())
+    QDataflowNode *uinode = node ? nodes_.value(node->id()) : 0L;
+    if(!uinode || uinode->modelNode() != node)
     {
         qDebug() << "WARNING:" << this << "does not know about" << node;
         return 0L;
     }
-    return *it;
+    return uinode;
 }
 
 QDataflowConnection * QDataflowCanvas::connection(QDataflowModelConnection *conn)
 {
-    QMap<QDataflowModelConnection*, QDataflowConnection*>::Iterator it = connections_.find(conn);
-    if(it == connections_.end())
+    QDataflowConnection *uiconn = conn ? connections_.value(conn->id()) : 0L;
+    if(!uiconn || uiconn->modelConnection() != conn)
     {
         qDebug() << "WARNING:" << this << "does not know about" << conn;
         return 0L;
     }
-    return *it;
+    return uiconn;
 }
 
 void QDataflowCanvas::raiseItem(QGraphicsItem *item)
@@ -185,6 +230,126 @@ void QDataflowCanvas::raiseItem(QGraphicsItem *item)
     }
 }
 
+void QDataflowCanvas::selectNodes(const QList<QDataflowModelNode*> &nodes)
+{
+    scene()->clearSelection();
+    foreach(QDataflowModelNode *mdlnode, nodes)
+        if(QDataflowNode *uinode = node(mdlnode))
+            uinode->setSelected(true);
+}
+
+void QDataflowCanvas::copySelection()
+{
+    QList<QDataflowModelNode*> mdlnodes;
+    foreach(QDataflowNode *node, selectedNodes())
+        mdlnodes.push_back(node->modelNode());
+    if(mdlnodes.isEmpty()) return;
+
+    QByteArray data = QDataflowTextFormat::toByteArray(mdlnodes);
+    QMimeData *mimeData = new QMimeData;
+    mimeData->setData("application/x-qdataflow-patch", data);
+    mimeData->setText(QString::fromUtf8(data));
+    QApplication::clipboard()->setMimeData(mimeData);
+    pasteCount_ = 0;
+}
+
+void QDataflowCanvas::paste()
+{
+    const QMimeData *mimeData = QApplication::clipboard()->mimeData();
+    if(!mimeData) return;
+    QByteArray data;
+    if(mimeData->hasFormat("application/x-qdataflow-patch"))
+        data = mimeData->data("application/x-qdataflow-patch");
+    else if(mimeData->hasText() && mimeData->text().startsWith("#N qdataflow"))
+        data = mimeData->text().toUtf8();
+    else
+        return;
+
+    // each paste is shifted a bit more, so that copies don't overlap
+    pasteCount_++;
+    QList<QDataflowModelNode*> created;
+    QDataflowTextFormat::load(model(), data, QPoint(20 * pasteCount_, 20 * pasteCount_), &created);
+    selectNodes(created);
+}
+
+void QDataflowCanvas::duplicateSelection()
+{
+    QList<QDataflowModelNode*> mdlnodes;
+    foreach(QDataflowNode *node, selectedNodes())
+        mdlnodes.push_back(node->modelNode());
+    if(mdlnodes.isEmpty()) return;
+    selectNodes(model()->cloneSubgraph(mdlnodes, QPoint(20, 20)));
+}
+
+int QDataflowCanvas::itemCount() const
+{
+    return ownedNodes_.size() + ownedConnections_.size();
+}
+
+void QDataflowCanvas::deleteItemLater(QGraphicsItem *item)
+{
+    // items are removed in response to model signals, possibly while one of
+    // them is handling an event: actual deletion happens in the event loop
+    if(removedItems_.isEmpty())
+        QTimer::singleShot(0, this, &QDataflowCanvas::deleteRemovedItems);
+    removedItems_.push_back(item);
+}
+
+void QDataflowCanvas::deleteRemovedItems()
+{
+    QList<QGraphicsItem*> items;
+    items.swap(removedItems_);
+    foreach(QGraphicsItem *item, items)
+    {
+        if(QDataflowNode *node = dynamic_cast<QDataflowNode*>(item))
+            ownedNodes_.remove(node);
+        else if(QDataflowConnection *conn = dynamic_cast<QDataflowConnection*>(item))
+            ownedConnections_.remove(conn);
+        delete item;
+    }
+}
+
+QDataflowCanvas * QDataflowCanvas::openSubpatch(QDataflowModelNode *node)
+{
+    QDataflowSubpatch *subpatch = node ? node->subpatch() : 0L;
+    if(!subpatch) return 0L;
+
+    for(QHash<QDataflowSubpatch*, QPointer<QDataflowCanvas> >::iterator it = subpatchCanvases_.begin(); it != subpatchCanvases_.end();)
+    {
+        if(it.value()) ++it;
+        else it = subpatchCanvases_.erase(it);
+    }
+
+    if(QDataflowCanvas *canvas = subpatchCanvases_.value(subpatch))
+    {
+        canvas->raise();
+        canvas->activateWindow();
+        return canvas;
+    }
+
+    // only what is shown gets loaded
+    subpatch->acquire();
+
+    QDataflowCanvas *canvas = new QDataflowCanvas(0L);
+    canvas->setAttribute(Qt::WA_DeleteOnClose);
+    canvas->setWindowTitle(node->text());
+    canvas->setCompletion(completion_);
+    canvas->subpatch_ = subpatch;
+    canvas->setModel(subpatch->model());
+    QObject::connect(subpatch, &QDataflowSubpatch::unloading, canvas, &QDataflowCanvas::onSubpatchUnloading);
+    subpatchCanvases_.insert(subpatch, canvas);
+    canvas->show();
+    return canvas;
+}
+
+void QDataflowCanvas::onSubpatchUnloading()
+{
+    // the subpatch node is going away: don't keep showing its contents
+    subpatch_ = 0L;
+    setModel(new QDataflowModel(this));
+    close();
+}
+
 void QDataflowCanvas::mouseDoubleClickEvent(QMouseEvent *event)
 {
     QGraphicsItem *item = itemAt(event->pos());
@@ -199,12 +364,22 @@ void QDataflowCanvas::mouseDoubleClickEvent(QMouseEvent *event)
     QGraphicsView::mouseDoubleClickEvent(event);
 }
 
+void QDataflowCanvas::mouseReleaseEvent(QMouseEvent *event)
+{
+    // a drag is over: next moves go into a new undo command
+    if(model() && model()->undoJournal())
+        model()->undoJournal()->seal();
+
+    QGraphicsView::mouseReleaseEvent(event);
+}
+
 void QDataflowCanvas::keyPressEvent(QKeyEvent *event)
 {
     event->ignore();
 
     if(event->key() == Qt::Key_Backspace && !isSomeNodeInEditMode())
     {
+        QDataflowModelUpdateGuard guard(model());
         foreach(QDataflowConnection *conn, selectedConnections())
             model()->disconnect(
                         conn->source()->node()->modelNode(), conn->source()->index(),
@@ -214,6 +389,31 @@ void QDataflowCanvas::keyPressEvent(QKeyEvent *event)
             model()->remove(node->modelNode());
         event->accept();
     }
+    else if(event->matches(QKeySequence::Copy) && !isSomeNodeInEditMode())
+    {
+        copySelection();
+        event->accept();
+    }
+    else if(event->matches(QKeySequence::Paste) && !isSomeNodeInEditMode())
+    {
+        paste();
+        event->accept();
+    }
+    else if(event->key() == Qt::Key_D && (event->modifiers() & Qt::ControlModifier) && !isSomeNodeInEditMode())
+    {
+        duplicateSelection();
+        event->accept();
+    }
+    else if(event->matches(QKeySequence::Undo) && !isSomeNodeInEditMode() && model()->undoJournal())
+    {
+        model()->undoJournal()->undo();
+        event->accept();
+    }
+    else if(event->matches(QKeySequence::Redo) && !isSomeNodeInEditMode() && model()->undoJournal())
+    {
+        model()->undoJournal()->redo();
+        event->accept();
+    }
 
     QGraphicsView::keyPressEvent(event);
 }
@@ -237,7 +437,10 @@ void QDataflowCanvas::itemTextEditorTextChange()
 void QDataflowCanvas::onNodeAdded(QDataflowModelNode *mdlnode)
 {
     QDataflowNode *uinode = new QDataflowNode(this, mdlnode);
-    nodes_[mdlnode] = uinode;
+    ownedNodes_.insert(uinode);
+    if(nodes_.size() <= mdlnode->id())
+        nodes_.resize(mdlnode->id() + 1);
+    nodes_[mdlnode->id()] = uinode;
     scene()->addItem(uinode);
 
     if(mdlnode->text() == "")
@@ -249,9 +452,12 @@ void QDataflowCanvas::onNodeAdded(QDataflowModelNode *mdlnode)
 void QDataflowCanvas::onNodeRemoved(QDataflowModelNode *mdlnode)
 {
     QDataflowNode *uinode = node(mdlnode);
+    if(!uinode) return;
     if(uinode->isInEditMode())
         uinode->exitEditMode(true);
     scene()->removeItem(uinode);
+    nodes_[mdlnode->id()] = 0L;
+    deleteItemLater(uinode);
 }
 
 void QDataflowCanvas::onNodeValidChanged(QDataflowModelNode *mdlnode, bool valid)
@@ -289,10 +495,27 @@ void QDataflowCanvas::onNodeOutletCountChanged(QDataflowModelNode *mdlnode, int
     uinode->setOutletCount(count);
 }
 
+void QDataflowCanvas::onNodeInletTypeChanged(QDataflowModelNode *mdlnode, int index, QString type)
+{
+    QDataflowNode *uinode = node(mdlnode);
+    if(uinode && index < uinode->inletCount())
+        uinode->inlet(index)->setTypeText(type);
+}
+
+void QDataflowCanvas::onNodeOutletTypeChanged(QDataflowModelNode *mdlnode, int index, QString type)
+{
+    QDataflowNode *uinode = node(mdlnode);
+    if(uinode && index < uinode->outletCount())
+        uinode->outlet(index)->setTypeText(type);
+}
+
 void QDataflowCanvas::onConnectionAdded(QDataflowModelConnection *mdlconn)
 {
     QDataflowConnection *uiconn = new QDataflowConnection(this, mdlconn);
-    connections_[mdlconn] = uiconn;
+    ownedConnections_.insert(uiconn);
+    if(connections_.size() <= mdlconn->id())
+        connections_.resize(mdlconn->id() + 1);
+    connections_[mdlconn->id()] = uiconn;
     scene()->addItem(uiconn);
     raiseItem(uiconn);
 }
@@ -300,7 +523,53 @@ void QDataflowCanvas::onConnectionAdded(QDataflowModelConnection *mdlconn)
 void QDataflowCanvas::onConnectionRemoved(QDataflowModelConnection *mdlconn)
 {
     QDataflowConnection *uiconn = connection(mdlconn);
-    scene()->removeItem(uiconn);
+    if(!uiconn) return;
+    uiconn->detach();
+    if(uiconn->scene())
+        scene()->removeItem(uiconn);
+    connections_[mdlconn->id()] = 0L;
+    deleteItemLater(uiconn);
+}
+
+void QDataflowCanvas::onNodesAdded(QList<QDataflowModelNode*> mdlnodes)
+{
+    foreach(QDataflowModelNode *mdlnode, mdlnodes)
+        onNodeAdded(mdlnode);
+}
+
+void QDataflowCanvas::onNodesRemoved(QList<QDataflowModelNode*> mdlnodes)
+{
+    foreach(QDataflowModelNode *mdlnode, mdlnodes)
+        onNodeRemoved(mdlnode);
+}
+
+void QDataflowCanvas::onConnectionsAdded(QList<QDataflowModelConnection*> mdlconns)
+{
+    QList<QDataflowConnection*> uiconns;
+    foreach(QDataflowModelConnection *mdlconn, mdlconns)
+    {
+        QDataflowConnection *uiconn = new QDataflowConnection(this, mdlconn);
+        ownedConnections_.insert(uiconn);
+        if(connections_.size() <= mdlconn->id())
+            connections_.resize(mdlconn->id() + 1);
+        connections_[mdlconn->id()] = uiconn;
+        scene()->addItem(uiconn);
+        uiconns.push_back(uiconn);
+    }
+
+    // raise all the new connections in a single pass, instead of calling
+    // raiseItem() (which looks for colliding items) for each one of them:
+    qreal maxZ = 0;
+    foreach(QGraphicsItem *item, scene()->items())
+        maxZ = qMax(maxZ, item->zValue());
+    foreach(QDataflowConnection *uiconn, uiconns)
+        uiconn->setZValue(maxZ + 1);
+}
+
+void QDataflowCanvas::onConnectionsRemoved(QList<QDataflowModelConnection*> mdlconns)
+{
+    foreach(QDataflowModelConnection *mdlconn, mdlconns)
+        onConnectionRemoved(mdlconn);
 }
 
 QDataflowNode::QDataflowNode(QDataflowCanvas *canvas, QDataflowModelNode *modelNode)
@@ -357,7 +626,13 @@ void QDataflowNode::setInletCount(int count, bool skipAdjust)
     {
         QDataflowInlet *lastInlet = inlets_.back();
         foreach(QDataflowConnection *conn, lastInlet->connections())
-            canvas()->scene()->removeItem(conn);
+        {
+            // the model connection may still be pending removal (e.g. in a
+            // model transaction): detach it now, as the inlet goes away
+            conn->detach();
+            if(conn->scene())
+                canvas()->scene()->removeItem(conn);
+        }
         canvas()->scene()->removeItem(lastInlet);
         inlets_.pop_back();
         delete lastInlet;
@@ -383,7 +658,13 @@ void QDataflowNode::setOutletCount(int count, bool skipAdjust)
     {
         QDataflowOutlet *lastOutlet = outlets_.back();
         foreach(QDataflowConnection *conn, lastOutlet->connections())
-            canvas()->scene()->removeItem(conn);
+        {
+            // the model connection may still be pending removal (e.g. in a
+            // model transaction): detach it now, as the outlet goes away
+            conn->detach();
+            if(conn->scene())
+                canvas()->scene()->removeItem(conn);
+        }
         canvas()->scene()->removeItem(lastOutlet);
         outlets_.pop_back();
         delete lastOutlet;
@@ -591,7 +872,11 @@ void QDataflowNode::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
 {
     if(!isInEditMode())
     {
-        enterEditMode();
+        // subpatches open on double click; Ctrl + double click edits them
+        if(modelNode()->subpatch() && !(event->modifiers() & Qt::ControlModifier))
+            canvas()->openSubpatch(modelNode());
+        else
+            enterEditMode();
         return;
     }
     event->ignore();
@@ -604,6 +889,13 @@ QDataflowIOlet::QDataflowIOlet(QDataflowNode *node, int index)
     setAcceptHoverEvents(true);
 }
 
+QDataflowIOlet::~QDataflowIOlet()
+{
+    // while hovered, the tooltip is reparented to the scene
+    if(!tooltip_->parentItem())
+        delete tooltip_;
+}
+
 void QDataflowIOlet::addConnection(QDataflowConnection *connection)
 {
     connections_ << connection;
@@ -647,6 +939,11 @@ void QDataflowIOlet::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
     tooltip_->setPos(QPointF(0,0));
 }
 
+void QDataflowIOlet::setTypeText(QString type)
+{
+    tooltip_->setText(type);
+}
+
 QRectF QDataflowIOlet::boundingRect() const
 {
     QDataflowNode *n = node();
@@ -668,7 +965,7 @@ void QDataflowIOlet::paint(QPainter *painter, const QStyleOptionGraphicsItem *op
 QDataflowInlet::QDataflowInlet(QDataflowNode *node, int index)
     : QDataflowIOlet(node, index)
 {
-    tooltip_ = new QDataflowTooltip(this, node->modelNode()->inlet(index)->type(), QPointF(0, -20));
+    tooltip_ = new QDataflowTooltip(this, node->modelNode()->inlet(index).type(), QPointF(0, -20));
     tooltip_->setZValue(std::numeric_limits<qreal>::max());
     tooltip_->setVisible(false);
 }
@@ -677,7 +974,7 @@ QDataflowOutlet::QDataflowOutlet(QDataflowNode *node, int index)
     : QDataflowIOlet(node, index), tmpConn_(0L)
 
 {
-    tooltip_ = new QDataflowTooltip(this, node->modelNode()->outlet(index)->type(), QPointF(0, 20));
+    tooltip_ = new QDataflowTooltip(this, node->modelNode()->outlet(index).type(), QPointF(0, 20));
     tooltip_->setZValue(std::numeric_limits<qreal>::max());
     tooltip_->setVisible(false);
 
@@ -728,9 +1025,9 @@ void QDataflowOutlet::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
         QDataflowInlet *inlet = node()->canvas()->itemAtT<QDataflowInlet>(event->scenePos());
 
         // check if connection can be done:
-        QDataflowModelOutlet *mdloutlet = node()->modelNode()->outlet(index());
-        QDataflowModelInlet *mdlinlet = inlet ? inlet->node()->modelNode()->inlet(inlet->index()) : nullptr;
-        bool canDo = inlet && mdloutlet->canMakeConnectionTo(mdlinlet) && mdlinlet->canAcceptConnectionFrom(mdloutlet);
+        QDataflowModelOutlet mdloutlet = node()->modelNode()->outlet(index());
+        QDataflowModelInlet mdlinlet = inlet ? inlet->node()->modelNode()->inlet(inlet->index()) : QDataflowModelInlet();
+        bool canDo = mdlinlet.isValid() && mdloutlet.canMakeConnectionTo(mdlinlet) && mdlinlet.canAcceptConnectionFrom(mdloutlet);
 
         tmpConn_->setPen(QPen(canDo ? Qt::black : Qt::red, 1, inlet ? Qt::SolidLine : Qt::DotLine, Qt::RoundCap, Qt::RoundJoin));
     }
@@ -743,10 +1040,10 @@ QDataflowConnection::QDataflowConnection(QDataflowCanvas *canvas, QDataflowModel
     setAcceptedMouseButtons(Qt::LeftButton);
     setAcceptHoverEvents(true);
 
-    QDataflowModelOutlet *src = modelConnection->source();
-    QDataflowModelInlet *dst = modelConnection->dest();
-    source_ = canvas->node(src->node())->outlet(src->index());
-    dest_ = canvas->node(dst->node())->inlet(dst->index());
+    QDataflowModelOutlet src = modelConnection->source();
+    QDataflowModelInlet dst = modelConnection->dest();
+    source_ = canvas->node(src.node())->outlet(src.index());
+    dest_ = canvas->node(dst.node())->inlet(dst.index());
     source_->addConnection(this);
     dest_->addConnection(this);
     adjust();
@@ -757,6 +1054,14 @@ QDataflowModelConnection * QDataflowConnection::modelConnection() const
     return modelConnection_;
 }
 
+void QDataflowConnection::detach()
+{
+    if(source_) source_->removeConnection(this);
+    if(dest_) dest_->removeConnection(this);
+    source_ = 0L;
+    dest_ = 0L;
+}
+
 void QDataflowConnection::adjust()
 {
     if(!source_ || !dest_)
@@ -23,8 +23,10 @@
 #include <QGraphicsSceneMouseEvent>
 #include <QMouseEvent>
 #include <QLineEdit>
+#include <QPointer>
 
 #include "qdataflowmodel.h"
+#include "qdataflowsubpatch.h"
 
 class QDataflowNode;
 class QDataflowInlet;
@@ -49,6 +51,7 @@ public:
     virtual ~QDataflowCanvas();
 
     QDataflowModel * model();
+    // the canvas takes ownership of models without a parent
     void setModel(QDataflowModel *model);
 
     QDataflowNode * node(QDataflowModelNode *node);
@@ -64,12 +67,29 @@ public:
 
     void raiseItem(QGraphicsItem *item);
 
+    void selectNodes(const QList<QDataflowModelNode*> &nodes);
+
+    // the clipboard holds nodes in the text patch format (see QDataflowTextFormat)
+    void copySelection();
+    void paste();
+    void duplicateSelection();
+
+    // number of node and connection items currently owned by the canvas
+    // (including removed items whose deletion is still pending)
+    int itemCount() const;
+
+    // show the contents of a subpatch node in a new window (or raise the
+    // window already showing them); the subpatch stays loaded while the
+    // window is open
+    QDataflowCanvas * openSubpatch(QDataflowModelNode *node);
+
 protected:
     template<typename T>
     T * itemAtT(const QPointF &point);
 
 protected slots:
     void mouseDoubleClickEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
     void keyPressEvent(QKeyEvent *event);
     void itemTextEditorTextChange();
     void onNodeAdded(QDataflowModelNode *mdlnode);
@@ -79,8 +99,16 @@ protected slots:
     void onNodeTextChanged(QDataflowModelNode *mdlnode, QString text);
     void onNodeInletCountChanged(QDataflowModelNode *mdlnode, int count);
     void onNodeOutletCountChanged(QDataflowModelNode *mdlnode, int count);
+    void onNodeInletTypeChanged(QDataflowModelNode *mdlnode, int index, QString type);
+    void onNodeOutletTypeChanged(QDataflowModelNode *mdlnode, int index, QString type);
     void onConnectionAdded(QDataflowModelConnection *mdlconn);
     void onConnectionRemoved(QDataflowModelConnection *mdlconn);
+    void onNodesAdded(QList<QDataflowModelNode*> mdlnodes);
+    void onNodesRemoved(QList<QDataflowModelNode*> mdlnodes);
+    void onConnectionsAdded(QList<QDataflowModelConnection*> mdlconns);
+    void onConnectionsRemoved(QList<QDataflowModelConnection*> mdlconns);
+    void deleteRemovedItems();
+    void onSubpatchUnloading();
 
     friend class QDataflowNode;
     friend class QDataflowIOlet;
@@ -89,12 +117,21 @@ protected slots:
     friend class QDataflowConnection;
 
 private:
+    void deleteItemLater(QGraphicsItem *item);
+
     QDataflowModel *model_;
     QDataflowTextCompletion *completion_;
+    QList<QGraphicsItem*> removedItems_;
+    int pasteCount_;
     QSet<QDataflowNode*> ownedNodes_;
     QSet<QDataflowConnection*> ownedConnections_;
-    QMap<QDataflowModelNode*, QDataflowNode*> nodes_;
-    QMap<QDataflowModelConnection*, QDataflowConnection*> connections_;
+    // indexed by the ID of the model node/connection:
+    QVector<QDataflowNode*> nodes_;
+    QVector<QDataflowConnection*> connections_;
+    // the subpatch shown by this canvas, and the windows opened for the
+    // subpatches of this canvas
+    QPointer<QDataflowSubpatch> subpatch_;
+    QHash<QDataflowSubpatch*, QPointer<QDataflowCanvas> > subpatchCanvases_;
 };
 
 class QDataflowNode : public QGraphicsItem
@@ -169,6 +206,8 @@ protected:
     QDataflowIOlet(QDataflowNode *node, int index);
 
 public:
+    virtual ~QDataflowIOlet();
+
     virtual int type() const = 0;
 
     QDataflowNode * node() const {return node_;}
@@ -184,6 +223,8 @@ public:
     void hoverEnterEvent(QGraphicsSceneHoverEvent *event);
     void hoverLeaveEvent(QGraphicsSceneHoverEvent *event);
 
+    void setTypeText(QString type);
+
 protected:
     QRectF boundingRect() const;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
@@ -209,7 +250,7 @@ protected:
 public:
     int type() const {return QDataflowItemTypeInlet;}
 
-    void onDataRecevied(void *data);
+    void onDataRecevied(const QDataflowMessage &message);
 
     friend class QDataflowCanvas;
     friend class QDataflowNode;
@@ -253,6 +294,8 @@ public:
     int type() const {return QDataflowItemTypeConnection;}
 
 protected:
+    void detach();
+
     QRectF boundingRect() const;
     QPainterPath shape() const;
 
@@ -267,6 +310,7 @@ private:
     QPointF destPoint_;
 
     friend class QDataflowCanvas;
+    friend class QDataflowNode;
     friend class QDataflowInlet;
     friend class QDataflowOutlet;
 };
@@ -0,0 +1,89 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowexecutionplan.h"
+#include "qdataflowmodel.h"
+
+QDataflowExecutionPlan::QDataflowExecutionPlan()
+    : revision_(-1)
+{
+    outletOffsets_.push_back(0);
+}
+
+QDataflowExecutionPlan::QDataflowExecutionPlan(const QDataflowModel *model, int revision)
+    : revision_(revision)
+{
+    nodes_.resize(model->nodeIdBound());
+    outletOffsets_.reserve(model->nodeCount() * 2 + 1);
+    targets_.reserve(model->connectionCount());
+
+    Node none = {0, 0, 0L};
+    nodes_.fill(none);
+
+    foreach(QDataflowModelNode *node, model->nodeRange())
+    {
+        Node &entry = nodes_[node->id()];
+        entry.firstOutlet = outletOffsets_.size();
+        entry.outletCount = node->outletCount();
+        entry.metaObject = node->dataflowMetaObject();
+
+        for(int i = 0; i < node->outletCount(); i++)
+        {
+            outletOffsets_.push_back(targets_.size());
+            foreach(QDataflowModelConnection *conn, node->outlets_.at(i).connections)
+            {
+                QDataflowMetaObject *mo = conn->dest().node()->dataflowMetaObject();
+                if(!mo) continue;
+                Target target = {mo, conn->dest().index(), conn->dest().node()->id(), conn->id(), conn->isQueued()};
+                targets_.push_back(target);
+            }
+        }
+    }
+    outletOffsets_.push_back(targets_.size());
+}
+
+QDataflowMetaObject * QDataflowExecutionPlan::metaObject(int nodeId) const
+{
+    if(nodeId < 0 || nodeId >= nodes_.size()) return 0L;
+    return nodes_.at(nodeId).metaObject;
+}
+
+int QDataflowExecutionPlan::outletCount(int nodeId) const
+{
+    if(nodeId < 0 || nodeId >= nodes_.size()) return 0;
+    return nodes_.at(nodeId).outletCount;
+}
+
+const QDataflowExecutionPlan::Target * QDataflowExecutionPlan::begin(int nodeId, int outlet) const
+{
+    if(outlet < 0 || outlet >= outletCount(nodeId)) return 0L;
+    return targets_.constData() + outletOffsets_.at(nodes_.at(nodeId).firstOutlet + outlet);
+}
+
+const QDataflowExecutionPlan::Target * QDataflowExecutionPlan::end(int nodeId, int outlet) const
+{
+    if(outlet < 0 || outlet >= outletCount(nodeId)) return 0L;
+    return targets_.constData() + outletOffsets_.at(nodes_.at(nodeId).firstOutlet + outlet + 1);
+}
+
+bool QDataflowExecutionPlan::targetRange(int nodeId, int outlet, int *first, int *last) const
+{
+    if(outlet < 0 || outlet >= outletCount(nodeId)) return false;
+    const int index = nodes_.at(nodeId).firstOutlet + outlet;
+    *first = outletOffsets_.at(index);
+    *last = outletOffsets_.at(index + 1);
+    return true;
+}
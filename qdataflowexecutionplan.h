@@ -0,0 +1,92 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWEXECUTIONPLAN_H
+#define QDATAFLOWEXECUTIONPLAN_H
+
+#include <QVector>
+
+class QDataflowModel;
+class QDataflowMetaObject;
+
+// The connections of a model compiled into flat arrays, for dispatching
+// messages (see QDataflowMetaObject::sendData()) without walking the
+// nodes, ports and connections of the model.
+//
+// For each outlet there is a contiguous range of targets (the meta object
+// of the destination node and the inlet index), in connection order;
+// the ranges of the outlets of a node are adjacent, and so are the ranges
+// of consecutive nodes, so a range ends where the next one begins.
+// Connections to nodes without a meta object are left out.
+//
+// The model rebuilds its plan (see QDataflowModel::executionPlan()) only
+// after connections, nodes, outlet counts, meta objects, thread groups or
+// transports have changed.
+// Plans are implicitly shared: a copy stays valid (and unchanged) when
+// the model rebuilds its own.
+class QDataflowExecutionPlan
+{
+public:
+    struct Target
+    {
+        QDataflowMetaObject *metaObject;
+        int inlet;
+        int nodeId;
+        int connectionId;
+        // see QDataflowModelConnection::isQueued()
+        bool queued;
+    };
+
+    QDataflowExecutionPlan();
+    explicit QDataflowExecutionPlan(const QDataflowModel *model, int revision = 0);
+
+    // revision of the model topology the plan was compiled from
+    int revision() const {return revision_;}
+
+    bool isEmpty() const {return targets_.isEmpty();}
+    int targetCount() const {return targets_.size();}
+
+    QDataflowMetaObject * metaObject(int nodeId) const;
+    int outletCount(int nodeId) const;
+
+    // targets of an outlet are [begin, end); both are null if the node or
+    // the outlet don't exist
+    const Target * begin(int nodeId, int outlet) const;
+    const Target * end(int nodeId, int outlet) const;
+
+    // the same, as indices in targets(); false if the outlet doesn't exist
+    bool targetRange(int nodeId, int outlet, int *first, int *last) const;
+    QVector<Target> targets() const {return targets_;}
+
+private:
+    struct Node
+    {
+        int firstOutlet; // index in outletOffsets_
+        int outletCount;
+        QDataflowMetaObject *metaObject;
+    };
+
+    int revision_;
+    // indexed by node ID; outletCount is 0 for removed IDs
+    QVector<Node> nodes_;
+    // start of the targets of each outlet, plus one past the end
+    QVector<int> outletOffsets_;
+    QVector<Target> targets_;
+};
+
+Q_DECLARE_TYPEINFO(QDataflowExecutionPlan::Target, Q_PRIMITIVE_TYPE);
+
+#endif // QDATAFLOWEXECUTIONPLAN_H
@@ -0,0 +1,337 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowexecutor.h"
+#include "qdataflowmodel.h"
+#include "qdataflowsubpatch.h"
+
+#include <QList>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QThread>
+#include <QWriteLocker>
+
+class QDataflowExecutorWorker : public QThread
+{
+public:
+    QDataflowExecutorWorker(QDataflowExecutor *executor, int index)
+        : executor_(executor), index_(index) {}
+
+    void run()
+    {
+        forever
+        {
+            int nodeId;
+            if(executor_->takeWork(this, &nodeId))
+            {
+                executor_->runNode(nodeId);
+                continue;
+            }
+
+            QMutexLocker locker(&executor_->idleMutex_);
+            if(executor_->stopping_) return;
+            if(executor_->queued_.load() == 0)
+                executor_->workAvailable_.wait(&executor_->idleMutex_);
+        }
+    }
+
+    QDataflowExecutor *executor_;
+    int index_;
+    // ready nodes: the owner takes from the back, thieves from the front
+    QMutex mutex_;
+    QList<int> queue_;
+};
+
+QDataflowExecutor::QDataflowExecutor(QDataflowModel *model, Mode mode, int threadCount)
+    : QObject(model), model_(model), mode_(mode), stopping_(false), draining_(false)
+{
+    // the old executor finishes its work (and detaches) first
+    delete model->executor_;
+    model->executor_ = this;
+
+    refresh();
+
+    if(mode_ == Threaded)
+    {
+        if(threadCount <= 0)
+            threadCount = QThread::idealThreadCount();
+        for(int i = 0; i < threadCount; i++)
+            workers_.push_back(new QDataflowExecutorWorker(this, i));
+        foreach(QDataflowExecutorWorker *worker, workers_)
+            worker->start();
+    }
+}
+
+QDataflowExecutor::~QDataflowExecutor()
+{
+    // stay attached until the workers are gone: messages they send must
+    // still come here, not go to the scheduler of their thread
+    waitForDone();
+
+    {
+        QMutexLocker locker(&idleMutex_);
+        stopping_ = true;
+        workAvailable_.wakeAll();
+    }
+    foreach(QDataflowExecutorWorker *worker, workers_)
+    {
+        worker->wait();
+        delete worker;
+    }
+
+    qDeleteAll(mailboxes_);
+
+    if(model_->executor_ == this)
+        model_->executor_ = 0L;
+
+    foreach(const QPointer<QDataflowSubpatch> &subpatch, subpatches_)
+        if(subpatch) subpatch->release();
+}
+
+QDataflowModel * QDataflowExecutor::model() const
+{
+    return model_;
+}
+
+QDataflowExecutor::Mode QDataflowExecutor::mode() const
+{
+    return mode_;
+}
+
+int QDataflowExecutor::threadCount() const
+{
+    return workers_.size();
+}
+
+void QDataflowExecutor::send(int nodeId, int outlet, const QDataflowMessage &message)
+{
+    if(QThread::currentThread() == model_->thread())
+        refresh();
+
+    const QDataflowExecutionPlan plan = this->plan();
+    int first, last;
+    if(!plan.targetRange(nodeId, outlet, &first, &last))
+        return;
+
+    const QVector<QDataflowExecutionPlan::Target> targets = plan.targets();
+    for(int i = first; i < last; i++)
+        post(targets.at(i).nodeId, targets.at(i).inlet, QDataflowMessage(message));
+
+    if(mode_ == Deterministic)
+        drain();
+}
+
+void QDataflowExecutor::waitForDone()
+{
+    if(mode_ == Deterministic)
+    {
+        drain();
+        return;
+    }
+
+    // a worker waiting for itself would never return
+    if(currentWorker()) return;
+
+    QMutexLocker locker(&idleMutex_);
+    while(pending_.load() > 0)
+        done_.wait(&idleMutex_);
+}
+
+bool QDataflowExecutor::isIdle() const
+{
+    return pending_.load() == 0;
+}
+
+int QDataflowExecutor::deliveredCount() const
+{
+    return delivered_.load();
+}
+
+int QDataflowExecutor::stealCount() const
+{
+    return steals_.load();
+}
+
+void QDataflowExecutor::refresh()
+{
+    // plan_ is only written from the model's thread
+    if(plan_.revision() == model_->topologyRevision()) return;
+
+    acquireSubpatches(model_);
+
+    // the workers run the nested models with the scheduler, which must
+    // find their plans already compiled
+    foreach(const QPointer<QDataflowSubpatch> &subpatch, subpatches_)
+        if(subpatch && subpatch->isLoaded())
+            subpatch->model()->executionPlan();
+
+    const QDataflowExecutionPlan plan = model_->executionPlan();
+    QWriteLocker locker(&lock_);
+    plan_ = plan;
+    mailboxes_.reserve(model_->nodeIdBound());
+    while(mailboxes_.size() < model_->nodeIdBound())
+        mailboxes_.push_back(new Mailbox());
+}
+
+void QDataflowExecutor::invalidate()
+{
+    // called by the model, once idle: the plan may refer to meta objects
+    // about to be deleted
+    QWriteLocker locker(&lock_);
+    plan_ = QDataflowExecutionPlan();
+}
+
+void QDataflowExecutor::acquireSubpatches(QDataflowModel *model)
+{
+    foreach(QDataflowModelNode *node, model->nodeRange())
+    {
+        QDataflowSubpatch *subpatch = node->subpatch();
+        if(!subpatch || subpatches_.value(subpatch)) continue;
+        subpatch->acquire();
+        subpatches_.insert(subpatch, subpatch);
+        acquireSubpatches(subpatch->model());
+    }
+}
+
+QDataflowExecutionPlan QDataflowExecutor::plan() const
+{
+    QReadLocker locker(&lock_);
+    return plan_;
+}
+
+void QDataflowExecutor::post(int nodeId, int inlet, QDataflowMessage &&message)
+{
+    Mailbox *box;
+    {
+        QReadLocker locker(&lock_);
+        box = mailboxes_.value(nodeId);
+    }
+    if(!box) return;
+
+    bool wasScheduled;
+    {
+        QMutexLocker locker(&box->mutex);
+        Delivery delivery = {inlet, std::move(message)};
+        box->queue.enqueue(delivery);
+        wasScheduled = box->scheduled;
+        box->scheduled = true;
+    }
+    if(!wasScheduled)
+        schedule(nodeId);
+}
+
+void QDataflowExecutor::schedule(int nodeId)
+{
+    pending_.ref();
+
+    if(mode_ == Deterministic)
+    {
+        ready_.enqueue(nodeId);
+        return;
+    }
+
+    QDataflowExecutorWorker *worker = currentWorker();
+    if(!worker)
+        worker = workers_.at(uint(nextWorker_.fetchAndAddOrdered(1)) % uint(workers_.size()));
+    {
+        QMutexLocker locker(&worker->mutex_);
+        worker->queue_.push_back(nodeId);
+    }
+    queued_.ref();
+
+    QMutexLocker locker(&idleMutex_);
+    workAvailable_.wakeOne();
+}
+
+void QDataflowExecutor::runNode(int nodeId)
+{
+    Mailbox *box;
+    QDataflowMetaObject *mo;
+    {
+        QReadLocker locker(&lock_);
+        box = mailboxes_.value(nodeId);
+        mo = plan_.metaObject(nodeId);
+    }
+
+    forever
+    {
+        Delivery delivery;
+        {
+            QMutexLocker locker(&box->mutex);
+            if(box->queue.isEmpty())
+            {
+                box->scheduled = false;
+                break;
+            }
+            delivery = box->queue.dequeue();
+        }
+        if(mo)
+            mo->receive(delivery.inlet, delivery.message);
+        delivered_.ref();
+    }
+
+    if(!pending_.deref())
+    {
+        QMutexLocker locker(&idleMutex_);
+        done_.wakeAll();
+    }
+}
+
+void QDataflowExecutor::drain()
+{
+    // messages sent by the nodes being run are queued, not run recursively
+    if(draining_) return;
+    draining_ = true;
+    while(!ready_.isEmpty())
+        runNode(ready_.dequeue());
+    draining_ = false;
+}
+
+QDataflowExecutorWorker * QDataflowExecutor::currentWorker() const
+{
+    QThread *thread = QThread::currentThread();
+    foreach(QDataflowExecutorWorker *worker, workers_)
+        if(worker == thread) return worker;
+    return 0L;
+}
+
+bool QDataflowExecutor::takeWork(QDataflowExecutorWorker *worker, int *nodeId)
+{
+    {
+        QMutexLocker locker(&worker->mutex_);
+        if(!worker->queue_.isEmpty())
+        {
+            *nodeId = worker->queue_.takeLast();
+            queued_.deref();
+            return true;
+        }
+    }
+
+    const int n = workers_.size();
+    for(int i = 1; i < n; i++)
+    {
+        QDataflowExecutorWorker *victim = workers_.at((worker->index_ + i) % n);
+        QMutexLocker locker(&victim->mutex_);
+        if(!victim->queue_.isEmpty())
+        {
+            *nodeId = victim->queue_.takeFirst();
+            queued_.deref();
+            steals_.ref();
+            return true;
+        }
+    }
+    return false;
+}
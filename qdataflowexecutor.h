@@ -0,0 +1,150 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWEXECUTOR_H
+#define QDATAFLOWEXECUTOR_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QQueue>
+#include <QReadWriteLock>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "qdataflowexecutionplan.h"
+#include "qdataflowmessage.h"
+
+class QDataflowModel;
+class QDataflowExecutorWorker;
+class QDataflowSubpatch;
+
+// Runs the nodes of a model on a pool of threads: once an executor is
+// created for a model (new QDataflowExecutor(model)), the messages sent
+// with QDataflowMetaObject::sendData() are queued in the mailbox of each
+// target node, and nodes with a non-empty mailbox are run by the workers,
+// so independent branches of the graph are processed in parallel.
+//
+// A node is run by one worker at a time, which delivers its messages in
+// the order they were queued: a meta object is never re-entered, nor
+// called from two threads at once, but it can be called from any worker
+// thread (meta objects touching widgets must go through queued calls).
+// Messages from one node to another keep their order; there is no
+// ordering between different paths, as there is with QDataflowScheduler.
+//
+// Each worker takes ready nodes from the back of its own queue (nodes
+// readied by the node it is running go there as well), and, when it has
+// nothing left, steals from the front of the queue of another worker.
+//
+// In Deterministic mode there are no threads: ready nodes are run in
+// FIFO order by the thread sending the first message, so runs are
+// reproducible (e.g. for testing).
+//
+// The model waits for the executor to be idle before changing the
+// topology or replacing meta objects; the changes are picked up by the
+// next message sent from the model's thread (until then, messages sent
+// from other threads are dropped).
+// Nested models can't be created by worker threads: subpatches (see
+// QDataflowSubpatch) are loaded by the executor, from the model's thread,
+// and kept loaded while it exists; their plans are compiled there as well,
+// and their contents run synchronously on the worker running the subpatch
+// node. Changes to a nested model wait for this executor, as above.
+class QDataflowExecutor : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode {Threaded, Deterministic};
+
+    // threadCount 0 means QThread::idealThreadCount()
+    explicit QDataflowExecutor(QDataflowModel *model, Mode mode = Threaded, int threadCount = 0);
+    virtual ~QDataflowExecutor();
+
+    QDataflowModel * model() const;
+    Mode mode() const;
+    int threadCount() const;
+
+    void send(int nodeId, int outlet, const QDataflowMessage &message);
+
+    // block until all the mailboxes are empty (not from a worker thread)
+    void waitForDone();
+    bool isIdle() const;
+
+    // statistics
+    int deliveredCount() const;
+    int stealCount() const;
+
+private:
+    struct Delivery
+    {
+        int inlet;
+        QDataflowMessage message;
+    };
+
+    struct Mailbox
+    {
+        Mailbox() : scheduled(false) {}
+
+        QMutex mutex;
+        QQueue<Delivery> queue;
+        // set while the node is queued or being run
+        bool scheduled;
+    };
+
+    void refresh();
+    void invalidate();
+    void acquireSubpatches(QDataflowModel *model);
+    QDataflowExecutionPlan plan() const;
+    void post(int nodeId, int inlet, QDataflowMessage &&message);
+    void schedule(int nodeId);
+    void runNode(int nodeId);
+    void drain();
+    QDataflowExecutorWorker * currentWorker() const;
+    bool takeWork(QDataflowExecutorWorker *worker, int *nodeId);
+
+    QDataflowModel *model_;
+    Mode mode_;
+
+    mutable QReadWriteLock lock_;
+    QDataflowExecutionPlan plan_;
+    // indexed by node ID
+    QVector<Mailbox*> mailboxes_;
+
+    QVector<QDataflowExecutorWorker*> workers_;
+    QAtomicInt nextWorker_;
+    // nodes waiting in the worker queues, and scheduled but not finished
+    QAtomicInt queued_;
+    QAtomicInt pending_;
+    QMutex idleMutex_;
+    QWaitCondition workAvailable_;
+    QWaitCondition done_;
+    bool stopping_;
+
+    QHash<QDataflowSubpatch*, QPointer<QDataflowSubpatch> > subpatches_;
+
+    // Deterministic mode
+    QQueue<int> ready_;
+    bool draining_;
+
+    QAtomicInt delivered_;
+    QAtomicInt steals_;
+
+    friend class QDataflowExecutorWorker;
+    friend class QDataflowModel;
+};
+
+#endif // QDATAFLOWEXECUTOR_H
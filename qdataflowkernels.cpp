@@ -0,0 +1,157 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowkernels.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QDATAFLOW_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// each op has a scalar form, and a vector form when QDATAFLOW_SSE2 is defined
+struct AddOp
+{
+    static float scalar(float a, float b) {return a + b;}
+#ifdef QDATAFLOW_SSE2
+    static __m128 vector(__m128 a, __m128 b) {return _mm_add_ps(a, b);}
+#endif
+};
+
+struct SubOp
+{
+    static float scalar(float a, float b) {return a - b;}
+#ifdef QDATAFLOW_SSE2
+    static __m128 vector(__m128 a, __m128 b) {return _mm_sub_ps(a, b);}
+#endif
+};
+
+struct MulOp
+{
+    static float scalar(float a, float b) {return a * b;}
+#ifdef QDATAFLOW_SSE2
+    static __m128 vector(__m128 a, __m128 b) {return _mm_mul_ps(a, b);}
+#endif
+};
+
+struct DivOp
+{
+    static float scalar(float a, float b) {return a / b;}
+#ifdef QDATAFLOW_SSE2
+    static __m128 vector(__m128 a, __m128 b) {return _mm_div_ps(a, b);}
+#endif
+};
+
+template<typename O>
+void applyScalar(const float *in, float operand, float *out, int n)
+{
+    int i = 0;
+#ifdef QDATAFLOW_SSE2
+    const __m128 b = _mm_set1_ps(operand);
+    // four vectors per iteration, to keep the pipeline busy
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128 a0 = _mm_loadu_ps(in + i);
+        __m128 a1 = _mm_loadu_ps(in + i + 4);
+        __m128 a2 = _mm_loadu_ps(in + i + 8);
+        __m128 a3 = _mm_loadu_ps(in + i + 12);
+        _mm_storeu_ps(out + i, O::vector(a0, b));
+        _mm_storeu_ps(out + i + 4, O::vector(a1, b));
+        _mm_storeu_ps(out + i + 8, O::vector(a2, b));
+        _mm_storeu_ps(out + i + 12, O::vector(a3, b));
+    }
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, O::vector(_mm_loadu_ps(in + i), b));
+#endif
+    for(; i < n; i++)
+        out[i] = O::scalar(in[i], operand);
+}
+
+template<typename O>
+void applyVector(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+#ifdef QDATAFLOW_SSE2
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128 a0 = _mm_loadu_ps(a + i);
+        __m128 a1 = _mm_loadu_ps(a + i + 4);
+        __m128 b0 = _mm_loadu_ps(b + i);
+        __m128 b1 = _mm_loadu_ps(b + i + 4);
+        _mm_storeu_ps(out + i, O::vector(a0, b0));
+        _mm_storeu_ps(out + i + 4, O::vector(a1, b1));
+    }
+    for(; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, O::vector(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+    for(; i < n; i++)
+        out[i] = O::scalar(a[i], b[i]);
+}
+
+} // namespace
+
+bool QDataflowKernels::opFromName(const QString &name, Op *op)
+{
+    if(name == "add") *op = Add;
+    else if(name == "sub") *op = Sub;
+    else if(name == "mul") *op = Mul;
+    else if(name == "div") *op = Div;
+    else if(name == "pow") *op = Pow;
+    else return false;
+    return true;
+}
+
+void QDataflowKernels::apply(Op op, const float *in, float operand, float *out, int n)
+{
+    switch(op)
+    {
+    case Add: applyScalar<AddOp>(in, operand, out, n); break;
+    case Sub: applyScalar<SubOp>(in, operand, out, n); break;
+    case Mul: applyScalar<MulOp>(in, operand, out, n); break;
+    case Div: applyScalar<DivOp>(in, operand, out, n); break;
+    case Pow:
+        for(int i = 0; i < n; i++)
+            out[i] = std::pow(in[i], operand);
+        break;
+    }
+}
+
+void QDataflowKernels::apply(Op op, const float *a, const float *b, float *out, int n)
+{
+    switch(op)
+    {
+    case Add: applyVector<AddOp>(a, b, out, n); break;
+    case Sub: applyVector<SubOp>(a, b, out, n); break;
+    case Mul: applyVector<MulOp>(a, b, out, n); break;
+    case Div: applyVector<DivOp>(a, b, out, n); break;
+    case Pow:
+        for(int i = 0; i < n; i++)
+            out[i] = std::pow(a[i], b[i]);
+        break;
+    }
+}
+
+bool QDataflowKernels::isVectorized()
+{
+#ifdef QDATAFLOW_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
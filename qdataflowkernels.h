@@ -0,0 +1,43 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWKERNELS_H
+#define QDATAFLOWKERNELS_H
+
+#include <QString>
+
+// Arithmetic over blocks of samples (see QDataflowMetaObject::processBlock()),
+// vectorized with SSE2 where available, with a plain loop for the other
+// targets and for the tail of each block. Outputs may alias inputs.
+// Pow has no vector form, and is always computed with std::pow.
+class QDataflowKernels
+{
+public:
+    enum Op {Add, Sub, Mul, Div, Pow};
+
+    // "add", "sub", "mul", "div", "pow"
+    static bool opFromName(const QString &name, Op *op);
+
+    // out[i] = in[i] op operand
+    static void apply(Op op, const float *in, float operand, float *out, int n);
+    // out[i] = a[i] op b[i]
+    static void apply(Op op, const float *a, const float *b, float *out, int n);
+
+    // whether the vector code paths have been compiled in
+    static bool isVectorized();
+};
+
+#endif // QDATAFLOWKERNELS_H
@@ -0,0 +1,235 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowmessage.h"
+
+#include <new>
+
+Q_STATIC_ASSERT(sizeof(QString) == sizeof(void*));
+Q_STATIC_ASSERT(sizeof(QByteArray) == sizeof(void*));
+Q_STATIC_ASSERT(sizeof(QVector<float>) == sizeof(void*));
+
+QDataflowMessage::QDataflowMessage(const char *s)
+    : type_(String)
+{
+    new (shared<QString>()) QString(QString::fromUtf8(s));
+}
+
+QDataflowMessage::QDataflowMessage(const QString &s)
+    : type_(String)
+{
+    new (shared<QString>()) QString(s);
+}
+
+QDataflowMessage::QDataflowMessage(QString &&s)
+    : type_(String)
+{
+    new (shared<QString>()) QString(std::move(s));
+}
+
+QDataflowMessage::QDataflowMessage(const QByteArray &bytes)
+    : type_(Bytes)
+{
+    new (shared<QByteArray>()) QByteArray(bytes);
+}
+
+QDataflowMessage::QDataflowMessage(QByteArray &&bytes)
+    : type_(Bytes)
+{
+    new (shared<QByteArray>()) QByteArray(std::move(bytes));
+}
+
+QDataflowMessage::QDataflowMessage(const QVector<float> &samples)
+    : type_(Samples)
+{
+    new (shared<QVector<float> >()) QVector<float>(samples);
+}
+
+QDataflowMessage::QDataflowMessage(QVector<float> &&samples)
+    : type_(Samples)
+{
+    new (shared<QVector<float> >()) QVector<float>(std::move(samples));
+}
+
+QDataflowMessage::QDataflowMessage(const QDataflowMessage &other)
+    : type_(other.type_)
+{
+    switch(type_)
+    {
+    case String: new (shared<QString>()) QString(*other.shared<QString>()); break;
+    case Bytes: new (shared<QByteArray>()) QByteArray(*other.shared<QByteArray>()); break;
+    case Samples: new (shared<QVector<float> >()) QVector<float>(*other.shared<QVector<float> >()); break;
+    default: data_ = other.data_; break;
+    }
+}
+
+QDataflowMessage & QDataflowMessage::operator=(const QDataflowMessage &other)
+{
+    if(this != &other)
+    {
+        QDataflowMessage copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+void QDataflowMessage::destroy()
+{
+    switch(type_)
+    {
+    case String: shared<QString>()->~QString(); break;
+    case Bytes: shared<QByteArray>()->~QByteArray(); break;
+    case Samples: shared<QVector<float> >()->~QVector<float>(); break;
+    default: break;
+    }
+    type_ = Null;
+}
+
+const char * QDataflowMessage::typeName(Type type)
+{
+    switch(type)
+    {
+    case Null: return "null";
+    case Bool: return "bool";
+    case Int: return "int";
+    case Double: return "double";
+    case String: return "string";
+    case Bytes: return "bytes";
+    case Samples: return "samples";
+    }
+    return "?";
+}
+
+bool QDataflowMessage::toBool() const
+{
+    switch(type_)
+    {
+    case Bool: return data_.b;
+    case Int: return data_.i != 0;
+    case Double: return data_.d != 0;
+    default: return toInt() != 0;
+    }
+}
+
+qint64 QDataflowMessage::toInt() const
+{
+    switch(type_)
+    {
+    case Bool: return data_.b ? 1 : 0;
+    case Int: return data_.i;
+    case Double: return qint64(data_.d);
+    case String: return shared<QString>()->toLongLong();
+    case Bytes: return shared<QByteArray>()->toLongLong();
+    default: return 0;
+    }
+}
+
+double QDataflowMessage::toDouble() const
+{
+    switch(type_)
+    {
+    case Bool: return data_.b ? 1 : 0;
+    case Int: return double(data_.i);
+    case Double: return data_.d;
+    case String: return shared<QString>()->toDouble();
+    case Bytes: return shared<QByteArray>()->toDouble();
+    default: return 0;
+    }
+}
+
+QString QDataflowMessage::toString() const
+{
+    switch(type_)
+    {
+    case Bool: return data_.b ? "1" : "0";
+    case Int: return QString::number(data_.i);
+    case Double: return QString::number(data_.d);
+    case String: return *shared<QString>();
+    case Bytes: return QString::fromUtf8(*shared<QByteArray>());
+    default: return QString();
+    }
+}
+
+QByteArray QDataflowMessage::toBytes() const
+{
+    switch(type_)
+    {
+    case Bytes: return *shared<QByteArray>();
+    case String: return shared<QString>()->toUtf8();
+    case Null: return QByteArray();
+    case Samples: return QByteArray(reinterpret_cast<const char*>(shared<QVector<float> >()->constData()), shared<QVector<float> >()->size() * int(sizeof(float)));
+    default: return toString().toUtf8();
+    }
+}
+
+QVector<float> QDataflowMessage::toSamples() const
+{
+    switch(type_)
+    {
+    case Samples: return *shared<QVector<float> >();
+    case Bool: case Int: case Double: return QVector<float>(1, float(toDouble()));
+    default: return QVector<float>();
+    }
+}
+
+const QString & QDataflowMessage::stringRef() const
+{
+    Q_ASSERT(type_ == String);
+    return *shared<QString>();
+}
+
+const QByteArray & QDataflowMessage::bytesRef() const
+{
+    Q_ASSERT(type_ == Bytes);
+    return *shared<QByteArray>();
+}
+
+const QVector<float> & QDataflowMessage::samplesRef() const
+{
+    Q_ASSERT(type_ == Samples);
+    return *shared<QVector<float> >();
+}
+
+bool QDataflowMessage::operator==(const QDataflowMessage &other) const
+{
+    if(type_ != other.type_) return false;
+    switch(type_)
+    {
+    case Null: return true;
+    case Bool: return data_.b == other.data_.b;
+    case Int: return data_.i == other.data_.i;
+    case Double: return data_.d == other.data_.d;
+    case String: return *shared<QString>() == *other.shared<QString>();
+    case Bytes: return *shared<QByteArray>() == *other.shared<QByteArray>();
+    case Samples: return *shared<QVector<float> >() == *other.shared<QVector<float> >();
+    }
+    return false;
+}
+
+QDebug operator<<(QDebug debug, const QDataflowMessage &message)
+{
+    QDebugStateSaver stateSaver(debug);
+    debug.nospace() << "QDataflowMessage(" << QDataflowMessage::typeName(message.type());
+    switch(message.type())
+    {
+    case QDataflowMessage::Null: break;
+    case QDataflowMessage::Bytes: debug << ", " << message.bytesRef().size() << " bytes"; break;
+    case QDataflowMessage::Samples: debug << ", " << message.samplesRef().size() << " samples"; break;
+    default: debug << ", " << message.toString(); break;
+    }
+    debug << ")";
+    return debug;
+}
@@ -0,0 +1,105 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWMESSAGE_H
+#define QDATAFLOWMESSAGE_H
+
+#include <QByteArray>
+#include <QDebug>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+// Value sent from an outlet to the connected inlets (see
+// QDataflowMetaObject::sendData()).
+//
+// Scalars (bool, integers, doubles) are stored inline; strings, byte
+// arrays and blocks of samples are stored as implicitly shared Qt
+// containers, so copying a message never copies (or allocates) its data,
+// and a message can be kept, queued or handed to another thread after the
+// sender is gone. Moving a message steals its contents and leaves the
+// source null.
+class QDataflowMessage
+{
+public:
+    enum Type {Null, Bool, Int, Double, String, Bytes, Samples};
+
+    QDataflowMessage() : type_(Null) {data_.i = 0;}
+    QDataflowMessage(bool b) : type_(Bool) {data_.i = 0; data_.b = b;}
+    QDataflowMessage(int i) : type_(Int) {data_.i = i;}
+    QDataflowMessage(qint64 i) : type_(Int) {data_.i = i;}
+    QDataflowMessage(double d) : type_(Double) {data_.d = d;}
+    QDataflowMessage(const char *s);
+    QDataflowMessage(const QString &s);
+    QDataflowMessage(QString &&s);
+    QDataflowMessage(const QByteArray &bytes);
+    QDataflowMessage(QByteArray &&bytes);
+    QDataflowMessage(const QVector<float> &samples);
+    QDataflowMessage(QVector<float> &&samples);
+
+    QDataflowMessage(const QDataflowMessage &other);
+    QDataflowMessage(QDataflowMessage &&other) : type_(other.type_), data_(other.data_) {other.type_ = Null;}
+    ~QDataflowMessage() {if(type_ >= String) destroy();}
+
+    QDataflowMessage & operator=(const QDataflowMessage &other);
+    QDataflowMessage & operator=(QDataflowMessage &&other) {QDataflowMessage tmp(std::move(other)); swap(tmp); return *this;}
+
+    void swap(QDataflowMessage &other) {qSwap(type_, other.type_); qSwap(data_, other.data_);}
+
+    Type type() const {return type_;}
+    bool isNull() const {return type_ == Null;}
+    static const char * typeName(Type type);
+
+    // conversions between scalars, and to/from the decimal representation
+    // of a number; a default value is returned for anything else
+    bool toBool() const;
+    qint64 toInt() const;
+    double toDouble() const;
+    QString toString() const;
+    QByteArray toBytes() const;
+    QVector<float> toSamples() const;
+
+    // access the contents without converting nor copying; the message
+    // must be of the given type
+    const QString & stringRef() const;
+    const QByteArray & bytesRef() const;
+    const QVector<float> & samplesRef() const;
+
+    bool operator==(const QDataflowMessage &other) const;
+    bool operator!=(const QDataflowMessage &other) const {return !(*this == other);}
+
+private:
+    void destroy();
+
+    template<typename T> T * shared() {return reinterpret_cast<T*>(&data_.shared);}
+    template<typename T> const T * shared() const {return reinterpret_cast<const T*>(&data_.shared);}
+
+    Type type_;
+    union {
+        bool b;
+        qint64 i;
+        double d;
+        // the d-pointer of a QString, QByteArray or QVector
+        void *shared;
+    } data_;
+};
+
+Q_DECLARE_TYPEINFO(QDataflowMessage, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(QDataflowMessage)
+
+QDebug operator<<(QDebug debug, const QDataflowMessage &message);
+
+#endif // QDATAFLOWMESSAGE_H
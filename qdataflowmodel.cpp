@@ -16,15 +16,39 @@
  */
 #include "qdataflowmodel.h"
 #include "qdataflowcanvas.h"
+#include "qdataflowexecutor.h"
+#include "qdataflowpipeline.h"
+#include "qdataflowpool.h"
+#include "qdataflowscheduler.h"
+#include "qdataflowsubpatch.h"
+#include "qdataflowtyperegistry.h"
+#include "qdataflowundojournal.h"
+
+#include <QThread>
+
+#include <algorithm>
 
 QDataflowModel::QDataflowModel(QObject *parent)
-    : QObject(parent)
+    : QObject(parent), nodeCount_(0), connectionCount_(0), updateDepth_(0), undoJournal_(0L), executor_(0L), pipeline_(0L),
+      snapshotDirty_(true), topologyRevision_(0)
 {
 
 }
 
+QDataflowModel::~QDataflowModel()
+{
+    // the journal must go before the nodes it refers to, and the executor
+    // and the pipeline before the meta objects they run
+    delete undoJournal_;
+    delete executor_;
+    delete pipeline_;
+}
+
 QDataflowModelNode * QDataflowModel::newNode(QPoint pos, QString text, int inletCount, int outletCount)
 {
+    if(QThread::currentThread() == thread())
+        return new QDataflowModelNode(this, pos, text, inletCount, outletCount);
+
     QDataflowModelNode *node = new QDataflowModelNode(0L, pos, text, inletCount, outletCount);
     node->moveToThread(thread());
     node->setParent(this);
@@ -33,6 +57,9 @@ QDataflowModelNode * QDataflowModel::newNode(QPoint pos, QString text, int inlet
 
 QDataflowModelConnection * QDataflowModel::newConnection(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet)
 {
+    if(QThread::currentThread() == thread())
+        return new QDataflowModelConnection(this, sourceNode->outlet(sourceOutlet), destNode->inlet(destInlet));
+
     QDataflowModelConnection *conn = new QDataflowModelConnection(0L, sourceNode->outlet(sourceOutlet), destNode->inlet(destInlet));
     conn->moveToThread(thread());
     conn->setParent(this);
@@ -41,39 +68,81 @@ QDataflowModelConnection * QDataflowModel::newConnection(QDataflowModelNode *sou
 
 QDataflowModelNode * QDataflowModel::create(QPoint pos, QString text, int inletCount, int outletCount)
 {
+    QDataflowUndoGroup undoGroup(this);
     QDataflowModelNode *node = newNode(pos, text, inletCount, outletCount);
-    nodes_.insert(node);
-    QObject::connect(node, &QDataflowModelNode::validChanged, this, &QDataflowModel::onValidChanged);
-    QObject::connect(node, &QDataflowModelNode::posChanged, this, &QDataflowModel::onPosChanged);
-    QObject::connect(node, &QDataflowModelNode::textChanged, this, &QDataflowModel::onTextChanged);
-    QObject::connect(node, &QDataflowModelNode::inletCountChanged, this, &QDataflowModel::onInletCountChanged);
-    QObject::connect(node, &QDataflowModelNode::outletCountChanged, this, &QDataflowModel::onOutletCountChanged);
-    emit nodeAdded(node);
+    node->id_ = nodes_.size();
+    nodes_.push_back(node);
+    addNode(node);
+    return node;
+}
+
+QDataflowModelNode * QDataflowModel::restoreNode(int id, QPoint pos, QString text, const QVector<int> &inletTypes, const QVector<int> &outletTypes)
+{
+    if(id < 0 || nodes_.value(id)) return 0L;
+    QDataflowModelNode *node = newNode(pos, text, 0, 0);
+    foreach(int type, inletTypes)
+        node->inlets_.push_back(QDataflowModelNode::IOlet{QString(), type, QVector<QDataflowModelConnection*>()});
+    foreach(int type, outletTypes)
+        node->outlets_.push_back(QDataflowModelNode::IOlet{QString(), type, QVector<QDataflowModelConnection*>()});
+    node->id_ = id;
+    if(nodes_.size() <= id)
+        nodes_.resize(id + 1);
+    nodes_[id] = node;
+    addNode(node);
     return node;
 }
 
+void QDataflowModel::addNode(QDataflowModelNode *node)
+{
+    nodeCount_++;
+    topology_.addNode(node->id_);
+    touchNode(node->id_);
+    invalidateExecutionPlan();
+    if(undoJournal_) undoJournal_->recordNodeCreated(node);
+    if(updateDepth_ > 0)
+    {
+        pendingNodesAdded_.push_back(node);
+        pendingNodesAddedSet_.insert(node);
+    }
+    else emit nodeAdded(node);
+}
+
 void QDataflowModel::remove(QDataflowModelNode *node)
 {
     if(!node) return;
-    if(!nodes_.contains(node)) return;
-    foreach(QDataflowModelInlet *inlet, node->inlets())
-        foreach(QDataflowModelConnection *conn, inlet->connections())
+    if(!contains(node)) return;
+    waitForIdle();
+    QDataflowUndoGroup undoGroup(this);
+    for(int i = 0; i < node->inletCount(); i++)
+        foreach(QDataflowModelConnection *conn, node->inlets_.at(i).connections)
             removeConnection(conn);
-    foreach(QDataflowModelOutlet *outlet, node->outlets())
-        foreach(QDataflowModelConnection *conn, outlet->connections())
+    for(int i = 0; i < node->outletCount(); i++)
+        foreach(QDataflowModelConnection *conn, node->outlets_.at(i).connections)
             removeConnection(conn);
-    QObject::disconnect(node, &QDataflowModelNode::validChanged, this, &QDataflowModel::onValidChanged);
-    QObject::disconnect(node, &QDataflowModelNode::posChanged, this, &QDataflowModel::onPosChanged);
-    QObject::disconnect(node, &QDataflowModelNode::textChanged, this, &QDataflowModel::onTextChanged);
-    QObject::disconnect(node, &QDataflowModelNode::inletCountChanged, this, &QDataflowModel::onInletCountChanged);
-    QObject::disconnect(node, &QDataflowModelNode::outletCountChanged, this, &QDataflowModel::onOutletCountChanged);
-    nodes_.remove(node);
-    emit nodeRemoved(node);
+    if(undoJournal_) undoJournal_->recordNodeRemoved(node);
+    nodes_[node->id_] = 0L;
+    nodeCount_--;
+    topology_.removeNode(node->id_);
+    touchNode(node->id_);
+    invalidateExecutionPlan();
+    if(updateDepth_ > 0)
+    {
+        if(!pendingNodesAddedSet_.remove(node))
+            pendingNodesRemoved_.push_back(node);
+        else
+            node->deleteLater();
+    }
+    else
+    {
+        emit nodeRemoved(node);
+        node->deleteLater();
+    }
 }
 
 QDataflowModelConnection * QDataflowModel::connect(QDataflowModelConnection *conn)
 {
     if(!conn) return 0L;
+    QDataflowUndoGroup undoGroup(this);
     if(!findConnections(conn).isEmpty()) return 0L;
     addConnection(conn);
     return conn;
@@ -83,14 +152,22 @@ QDataflowModelConnection * QDataflowModel::connect(QDataflowModelNode *sourceNod
 {
     if(!sourceNode || !destNode) return 0L;
     if(!findConnections(sourceNode, sourceOutlet, destNode, destInlet).isEmpty()) return 0L;
+    QDataflowUndoGroup undoGroup(this);
     QDataflowModelConnection *conn = newConnection(sourceNode, sourceOutlet, destNode, destInlet);
     addConnection(conn);
+    if(!contains(conn))
+    {
+        // refused (e.g. incompatible types)
+        delete conn;
+        return 0L;
+    }
     return conn;
 }
 
 void QDataflowModel::disconnect(QDataflowModelConnection *conn)
 {
     if(!conn) return;
+    QDataflowUndoGroup undoGroup(this);
     foreach(QDataflowModelConnection *conn, findConnections(conn))
     {
         removeConnection(conn);
@@ -100,46 +177,546 @@ void QDataflowModel::disconnect(QDataflowModelConnection *conn)
 void QDataflowModel::disconnect(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet)
 {
     if(!sourceNode || !destNode) return;
+    QDataflowUndoGroup undoGroup(this);
     foreach(QDataflowModelConnection *conn, findConnections(sourceNode, sourceOutlet, destNode, destInlet))
     {
         removeConnection(conn);
     }
 }
 
+void QDataflowModel::clear()
+{
+    // inside an enclosing transaction the removed objects are reported
+    // (and deleted later) by the outermost endUpdate(), as usual
+    const bool owned = updateDepth_ == 0;
+
+    QList<QDataflowModelNode*> removedNodes;
+    QList<QDataflowModelConnection*> removedConns;
+    foreach(QDataflowModelNode *node, nodeRange())
+        removedNodes.push_back(node);
+    foreach(QDataflowModelConnection *conn, connectionRange())
+        removedConns.push_back(conn);
+
+    beginUpdate();
+    foreach(QDataflowModelNode *node, removedNodes)
+        remove(node);
+    endUpdate();
+
+    if(!owned) return;
+
+    // everything has been reported as removed: release the memory in bulk
+    // (this also drops the pending deferred deletes)
+    qDeleteAll(removedConns);
+    qDeleteAll(removedNodes);
+
+    // the pools are shared by all the models of the process
+    if(QDataflowPool<QDataflowModelConnection>::instance().liveCount() == 0)
+        QDataflowPool<QDataflowModelConnection>::instance().trim();
+    if(QDataflowPool<QDataflowModelNode>::instance().liveCount() == 0)
+        QDataflowPool<QDataflowModelNode>::instance().trim();
+}
+
+void QDataflowModel::beginUpdate()
+{
+    if(undoJournal_) undoJournal_->beginCommand();
+    updateDepth_++;
+}
+
+void QDataflowModel::endUpdate()
+{
+    if(updateDepth_ <= 0) return;
+    if(--updateDepth_ > 0)
+    {
+        if(undoJournal_) undoJournal_->endCommand();
+        return;
+    }
+
+    QList<QDataflowModelConnection*> removedConns, addedConns;
+    QList<QDataflowModelNode*> removedNodes, addedNodes;
+    removedConns.swap(pendingConnectionsRemoved_);
+    removedNodes.swap(pendingNodesRemoved_);
+    foreach(QDataflowModelNode *node, pendingNodesAdded_)
+        if(pendingNodesAddedSet_.contains(node))
+            addedNodes.push_back(node);
+    foreach(QDataflowModelConnection *conn, pendingConnectionsAdded_)
+        if(pendingConnectionsAddedSet_.contains(conn))
+            addedConns.push_back(conn);
+    pendingNodesAdded_.clear();
+    pendingNodesAddedSet_.clear();
+    pendingConnectionsAdded_.clear();
+    pendingConnectionsAddedSet_.clear();
+
+    if(!removedConns.isEmpty()) emit connectionsRemoved(removedConns);
+    if(!removedNodes.isEmpty()) emit nodesRemoved(removedNodes);
+    if(!addedNodes.isEmpty()) emit nodesAdded(addedNodes);
+    if(!addedConns.isEmpty()) emit connectionsAdded(addedConns);
+
+    // removed objects stay valid until control returns to the event loop,
+    // so that receivers of the above signals can still inspect them
+    foreach(QDataflowModelConnection *conn, removedConns)
+        conn->deleteLater();
+    foreach(QDataflowModelNode *node, removedNodes)
+        node->deleteLater();
+
+    // the undo command includes the changes made by the receivers above
+    if(undoJournal_) undoJournal_->endCommand();
+}
+
+bool QDataflowModel::isUpdating() const
+{
+    return updateDepth_ > 0;
+}
+
+QList<QDataflowModelNode*> QDataflowModel::cloneSubgraph(const QList<QDataflowModelNode*> &nodes, QPoint offset)
+{
+    QList<QDataflowModelNode*> ret, originals;
+    QHash<QDataflowModelNode*, QDataflowModelNode*> clones;
+    clones.reserve(nodes.size());
+    int connectionCount = 0;
+    foreach(QDataflowModelNode *node, nodes)
+    {
+        if(!contains(node) || clones.contains(node)) continue;
+        clones.insert(node, 0L);
+        for(int i = 0; i < node->outletCount(); i++)
+            connectionCount += node->outlets_.at(i).connections.size();
+    }
+
+    QDataflowModelUpdateGuard guard(this);
+    reserve(clones.size(), connectionCount);
+
+    foreach(QDataflowModelNode *node, nodes)
+    {
+        QHash<QDataflowModelNode*, QDataflowModelNode*>::iterator it = clones.find(node);
+        if(it == clones.end() || it.value()) continue;
+        // the clone is pending until the end of the transaction, so its
+        // ports can be copied directly
+        QDataflowModelNode *clone = create(node->pos() + offset, node->text(), 0, 0);
+        clone->inlets_ = node->inlets_;
+        for(int i = 0; i < clone->inlets_.size(); i++)
+            clone->inlets_[i].connections.clear();
+        clone->outlets_ = node->outlets_;
+        for(int i = 0; i < clone->outlets_.size(); i++)
+            clone->outlets_[i].connections.clear();
+        if(node->subpatch_)
+            clone->makeSubpatch()->setContents(node->subpatch_->contents());
+        it.value() = clone;
+        originals.push_back(node);
+        ret.push_back(clone);
+    }
+
+    // internal connections: the clones have no connections yet, so these
+    // can't be duplicates and are compatible (same types as the originals),
+    // and are inserted without checking, invalidating the plan once;
+    // walk them in the order given, so that the IDs are reproducible
+    bool connected = false;
+    for(int n = 0; n < originals.size(); n++)
+    {
+        QDataflowModelNode *node = originals.at(n);
+        for(int i = 0; i < node->outletCount(); i++)
+        {
+            foreach(QDataflowModelConnection *conn, node->outlets_.at(i).connections)
+            {
+                QDataflowModelNode *dest = clones.value(conn->dest_.node());
+                if(!dest) continue;
+                insertConnection(newConnection(ret.at(n), i, dest, conn->dest_.index()));
+                connected = true;
+            }
+        }
+    }
+
+    if(connected)
+        invalidateExecutionPlan();
+
+    return ret;
+}
+
+QList<QDataflowModelNode*> QDataflowModel::topologicalOrder() const
+{
+    QList<QDataflowModelNode*> ret;
+    foreach(int id, topology_.order())
+        ret.push_back(nodes_.at(id));
+    return ret;
+}
+
+bool QDataflowModel::isAcyclic() const
+{
+    return topology_.isAcyclic();
+}
+
+bool QDataflowModel::wouldCreateCycle(const QDataflowModelOutlet &outlet, const QDataflowModelInlet &inlet) const
+{
+    if(!outlet.isValid() || !inlet.isValid()) return false;
+    if(!contains(outlet.node()) || !contains(inlet.node())) return false;
+    return topology_.wouldCreateCycle(outlet.node()->id(), inlet.node()->id());
+}
+
+QList<QList<QDataflowModelNode*> > QDataflowModel::stronglyConnectedComponents() const
+{
+    QList<QList<QDataflowModelNode*> > ret;
+    foreach(const QVector<int> &component, topology_.stronglyConnectedComponents())
+    {
+        QList<QDataflowModelNode*> nodes;
+        foreach(int id, component)
+            nodes.push_back(nodes_.at(id));
+        ret.push_back(nodes);
+    }
+    return ret;
+}
+
+QList<QDataflowModelNode*> QDataflowModel::downstreamNodes(QDataflowModelNode *node) const
+{
+    if(!contains(node)) return QList<QDataflowModelNode*>();
+    return nodesFromBits(topology_.downstream(node->id()));
+}
+
+QList<QDataflowModelNode*> QDataflowModel::upstreamNodes(QDataflowModelNode *node) const
+{
+    if(!contains(node)) return QList<QDataflowModelNode*>();
+    return nodesFromBits(topology_.upstream(node->id()));
+}
+
+QList<QDataflowModelNode*> QDataflowModel::downstreamNodes(const QList<QDataflowModelNode*> &nodes) const
+{
+    return nodesFromBits(topology_.downstream(nodeIds(nodes)));
+}
+
+QList<QDataflowModelNode*> QDataflowModel::upstreamNodes(const QList<QDataflowModelNode*> &nodes) const
+{
+    return nodesFromBits(topology_.upstream(nodeIds(nodes)));
+}
+
+bool QDataflowModel::isReachable(QDataflowModelNode *source, QDataflowModelNode *dest) const
+{
+    if(!contains(source) || !contains(dest)) return false;
+    return topology_.isReachable(source->id(), dest->id());
+}
+
+void QDataflowModel::touchNode(int id)
+{
+    if(id < 0) return;
+    snapshotDirty_ = true;
+    // chunks past the end of the last snapshot are built anyway
+    int chunk = id >> QDataflowModelSnapshot::ChunkShift;
+    if(chunk < dirtyNodeChunks_.size())
+        dirtyNodeChunks_.setBit(chunk);
+}
+
+void QDataflowModel::touchConnection(int id)
+{
+    if(id < 0) return;
+    snapshotDirty_ = true;
+    int chunk = id >> QDataflowModelSnapshot::ChunkShift;
+    if(chunk < dirtyConnectionChunks_.size())
+        dirtyConnectionChunks_.setBit(chunk);
+}
+
+void QDataflowModel::waitForIdle()
+{
+    if(executor_) executor_->waitForDone();
+    // the pipeline is set up for the current graph: it has to be started
+    // again after the change
+    if(pipeline_) pipeline_->stop();
+}
+
+void QDataflowModel::invalidateExecutionPlan()
+{
+    waitForIdle();
+    topologyRevision_.ref();
+    if(executor_) executor_->invalidate();
+
+    // nested models are run along with the model of their subpatch node,
+    // whose executor must pick up their changes too
+    if(QDataflowSubpatch *subpatch = QDataflowSubpatch::forModel(this))
+        if(QDataflowModel *parentModel = subpatch->node()->model())
+            parentModel->invalidateExecutionPlan();
+}
+
+QVector<int> QDataflowModel::nodeIds(const QList<QDataflowModelNode*> &nodes) const
+{
+    QVector<int> ret;
+    ret.reserve(nodes.size());
+    foreach(QDataflowModelNode *node, nodes)
+        if(contains(node)) ret.push_back(node->id());
+    return ret;
+}
+
+QList<QDataflowModelNode*> QDataflowModel::nodesFromBits(const QBitArray &bits) const
+{
+    QList<QDataflowModelNode*> ret;
+    for(int id = 0; id < bits.size(); id++)
+        if(bits.testBit(id) && nodes_.value(id))
+            ret.push_back(nodes_.at(id));
+    return ret;
+}
+
+bool QDataflowModel::isPending(QDataflowModelNode *node) const
+{
+    return updateDepth_ > 0 && pendingNodesAddedSet_.contains(node);
+}
+
 QSet<QDataflowModelNode*> QDataflowModel::nodes()
 {
-    return nodes_;
+    QSet<QDataflowModelNode*> ret;
+    ret.reserve(nodeCount_);
+    foreach(QDataflowModelNode *node, nodeRange())
+        ret.insert(node);
+    return ret;
 }
 
 QSet<QDataflowModelConnection*> QDataflowModel::connections()
 {
-    return connections_;
+    QSet<QDataflowModelConnection*> ret;
+    ret.reserve(connectionCount_);
+    foreach(QDataflowModelConnection *conn, connectionRange())
+        ret.insert(conn);
+    return ret;
+}
+
+QDataflowModelItemRange<QDataflowModelNode> QDataflowModel::nodeRange() const
+{
+    return QDataflowModelItemRange<QDataflowModelNode>(nodes_, nodeCount_);
+}
+
+QDataflowModelItemRange<QDataflowModelConnection> QDataflowModel::connectionRange() const
+{
+    return QDataflowModelItemRange<QDataflowModelConnection>(connections_, connectionCount_);
+}
+
+int QDataflowModel::nodeCount() const
+{
+    return nodeCount_;
+}
+
+int QDataflowModel::connectionCount() const
+{
+    return connectionCount_;
+}
+
+bool QDataflowModel::contains(QDataflowModelNode *node) const
+{
+    return node && node->id_ >= 0 && node->id_ < nodes_.size() && nodes_[node->id_] == node;
+}
+
+bool QDataflowModel::contains(QDataflowModelConnection *conn) const
+{
+    return conn && conn->id_ >= 0 && conn->id_ < connections_.size() && connections_[conn->id_] == conn;
+}
+
+QDataflowModelNode * QDataflowModel::node(int id) const
+{
+    return nodes_.value(id);
+}
+
+QDataflowModelConnection * QDataflowModel::connection(int id) const
+{
+    return connections_.value(id);
+}
+
+int QDataflowModel::nodeIdBound() const
+{
+    return nodes_.size();
+}
+
+int QDataflowModel::connectionIdBound() const
+{
+    return connections_.size();
+}
+
+QDataflowUndoJournal * QDataflowModel::undoJournal() const
+{
+    return undoJournal_;
+}
+
+QDataflowExecutor * QDataflowModel::executor() const
+{
+    return executor_;
+}
+
+QDataflowPipeline * QDataflowModel::pipeline() const
+{
+    return pipeline_;
+}
+
+QDataflowModelSnapshot QDataflowModel::snapshot() const
+{
+    if(snapshotDirty_)
+    {
+        snapshot_ = QDataflowModelSnapshot(this, snapshot_, dirtyNodeChunks_, dirtyConnectionChunks_);
+        dirtyNodeChunks_.fill(false, (nodes_.size() + QDataflowModelSnapshot::ChunkSize - 1) >> QDataflowModelSnapshot::ChunkShift);
+        dirtyConnectionChunks_.fill(false, (connections_.size() + QDataflowModelSnapshot::ChunkSize - 1) >> QDataflowModelSnapshot::ChunkShift);
+        snapshotDirty_ = false;
+    }
+    return snapshot_;
+}
+
+const QDataflowExecutionPlan & QDataflowModel::executionPlan() const
+{
+    const int revision = topologyRevision_.loadAcquire();
+    if(executionPlan_.revision() != revision)
+        executionPlan_ = QDataflowExecutionPlan(this, revision);
+    return executionPlan_;
+}
+
+int QDataflowModel::topologyRevision() const
+{
+    return topologyRevision_.loadAcquire();
+}
+
+void QDataflowModel::reserve(int nodeCount, int connectionCount)
+{
+    nodes_.reserve(nodes_.size() + nodeCount);
+    connections_.reserve(connections_.size() + connectionCount);
+    connectionIndex_.reserve(connectionIndex_.size() + connectionCount);
+    if(updateDepth_ > 0)
+    {
+        pendingNodesAdded_.reserve(pendingNodesAdded_.size() + nodeCount);
+        pendingNodesAddedSet_.reserve(pendingNodesAddedSet_.size() + nodeCount);
+        pendingConnectionsAdded_.reserve(pendingConnectionsAdded_.size() + connectionCount);
+        pendingConnectionsAddedSet_.reserve(pendingConnectionsAddedSet_.size() + connectionCount);
+    }
+}
+
+void QDataflowModel::beginBulkInsert()
+{
+    waitForIdle();
+    beginUpdate();
+}
+
+QDataflowModelNode * QDataflowModel::appendNode(QPoint pos, const QString &text, const QVector<int> &inletTypes, const QVector<int> &outletTypes)
+{
+    QDataflowModelNode *node = newNode(pos, text, 0, 0);
+    node->inlets_.reserve(inletTypes.size());
+    foreach(int type, inletTypes)
+        node->inlets_.push_back(QDataflowModelNode::IOlet{QString(), type, QVector<QDataflowModelConnection*>()});
+    node->outlets_.reserve(outletTypes.size());
+    foreach(int type, outletTypes)
+        node->outlets_.push_back(QDataflowModelNode::IOlet{QString(), type, QVector<QDataflowModelConnection*>()});
+    node->id_ = nodes_.size();
+    nodes_.push_back(node);
+    nodeCount_++;
+    topology_.addNode(node->id_);
+    touchNode(node->id_);
+    pendingNodesAdded_.push_back(node);
+    pendingNodesAddedSet_.insert(node);
+    return node;
+}
+
+QDataflowModelConnection * QDataflowModel::appendConnection(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet)
+{
+    const ConnectionKey key(sourceNode->outlet(sourceOutlet), destNode->inlet(destInlet));
+    if(connectionIndex_.contains(key)) return 0L;
+    if(!QDataflowTypeRegistry::instance()->isCompatible(key.first.typeId(), key.second.typeId())) return 0L;
+
+    QDataflowModelConnection *conn = newConnection(sourceNode, sourceOutlet, destNode, destInlet);
+    conn->id_ = connections_.size();
+    connections_.push_back(conn);
+    connectionCount_++;
+    connectionIndex_.insert(key, conn);
+    sourceNode->outlets_[sourceOutlet].connections.push_back(conn);
+    destNode->inlets_[destInlet].connections.push_back(conn);
+    bulkEdges_.push_back(qMakePair(sourceNode->id_, destNode->id_));
+    touchConnection(conn->id_);
+    touchNode(sourceNode->id_);
+    touchNode(destNode->id_);
+    pendingConnectionsAdded_.push_back(conn);
+    pendingConnectionsAddedSet_.insert(conn);
+    return conn;
+}
+
+void QDataflowModel::endBulkInsert()
+{
+    topology_.addEdges(bulkEdges_);
+    bulkEdges_.clear();
+    invalidateExecutionPlan();
+    endUpdate();
+    if(undoJournal_) undoJournal_->clear();
 }
 
 void QDataflowModel::addConnection(QDataflowModelConnection *conn)
 {
-    if(!conn) return;
+    if(!conn || !conn->source().isValid() || !conn->dest().isValid()) return;
     if(!findConnections(conn).isEmpty()) return;
-    if(!conn->source()->canMakeConnectionTo(conn->dest()) || !conn->dest()->canAcceptConnectionFrom(conn->source()))
+    if(!conn->source().canMakeConnectionTo(conn->dest()) || !conn->dest().canAcceptConnectionFrom(conn->source()))
     {
         qDebug() << "cannoct connect outlet" << conn->source() << "to inlet" << conn->dest();
         return;
     }
+    insertConnection(conn);
+    invalidateExecutionPlan();
+}
+
+void QDataflowModel::insertConnection(QDataflowModelConnection *conn)
+{
     conn->setParent(this);
-    connections_.insert(conn);
-    conn->source()->addConnection(conn);
-    conn->dest()->addConnection(conn);
-    emit connectionAdded(conn);
+    if(conn->id_ >= 0 && conn->id_ < connections_.size() && !connections_.at(conn->id_))
+    {
+        // restored connection (see restoreConnection())
+        connections_[conn->id_] = conn;
+    }
+    else
+    {
+        conn->id_ = connections_.size();
+        connections_.push_back(conn);
+    }
+    connectionCount_++;
+    connectionIndex_.insert(ConnectionKey(conn->source(), conn->dest()), conn);
+    conn->source_.node()->outlets_[conn->source_.index()].connections.push_back(conn);
+    conn->dest_.node()->inlets_[conn->dest_.index()].connections.push_back(conn);
+    topology_.addEdge(conn->source_.node()->id_, conn->dest_.node()->id_);
+    touchConnection(conn->id_);
+    touchNode(conn->source_.node()->id_);
+    touchNode(conn->dest_.node()->id_);
+    if(undoJournal_) undoJournal_->recordConnectionAdded(conn);
+    if(updateDepth_ > 0)
+    {
+        pendingConnectionsAdded_.push_back(conn);
+        pendingConnectionsAddedSet_.insert(conn);
+    }
+    else emit connectionAdded(conn);
 }
 
 void QDataflowModel::removeConnection(QDataflowModelConnection *conn)
 {
     if(!conn) return;
-    if(!connections_.contains(conn)) return;
-    conn->source()->removeConnection(conn);
-    conn->dest()->removeConnection(conn);
-    connections_.remove(conn);
-    emit connectionRemoved(conn);
+    if(!contains(conn)) return;
+    conn->source_.node()->outlets_[conn->source_.index()].connections.removeAll(conn);
+    conn->dest_.node()->inlets_[conn->dest_.index()].connections.removeAll(conn);
+    connections_[conn->id_] = 0L;
+    connectionCount_--;
+    connectionIndex_.remove(ConnectionKey(conn->source(), conn->dest()));
+    topology_.removeEdge(conn->source_.node()->id_, conn->dest_.node()->id_);
+    invalidateExecutionPlan();
+    touchConnection(conn->id_);
+    touchNode(conn->source_.node()->id_);
+    touchNode(conn->dest_.node()->id_);
+    if(undoJournal_) undoJournal_->recordConnectionRemoved(conn);
+    if(updateDepth_ > 0)
+    {
+        if(!pendingConnectionsAddedSet_.remove(conn))
+            pendingConnectionsRemoved_.push_back(conn);
+        else
+            conn->deleteLater();
+    }
+    else
+    {
+        emit connectionRemoved(conn);
+        conn->deleteLater();
+    }
+}
+
+QDataflowModelConnection * QDataflowModel::restoreConnection(int id, QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet)
+{
+    if(!contains(sourceNode) || !contains(destNode)) return 0L;
+    if(id < 0 || id >= connections_.size() || connections_.at(id)) return 0L;
+    QDataflowModelConnection *conn = newConnection(sourceNode, sourceOutlet, destNode, destInlet);
+    conn->id_ = id;
+    addConnection(conn);
+    if(!contains(conn))
+    {
+        delete conn;
+        return 0L;
+    }
+    return conn;
 }
 
 QList<QDataflowModelConnection*> QDataflowModel::findConnections(QDataflowModelConnection *conn) const
@@ -148,68 +725,96 @@ QList<QDataflowModelConnection*> QDataflowModel::findConnections(QDataflowModelC
     return findConnections(conn->source(), conn->dest());
 }
 
-QList<QDataflowModelConnection*> QDataflowModel::findConnections(QDataflowModelOutlet *source, QDataflowModelInlet *dest) const
+QList<QDataflowModelConnection*> QDataflowModel::findConnections(const QDataflowModelOutlet &source, const QDataflowModelInlet &dest) const
 {
-    if(!source || !dest) return QList<QDataflowModelConnection*>();
-    return findConnections(source->node(), source->index(), dest->node(), dest->index());
+    QList<QDataflowModelConnection*> ret;
+    if(!source.isValid() || !dest.isValid()) return ret;
+    if(QDataflowModelConnection *conn = connectionIndex_.value(ConnectionKey(source, dest)))
+        ret.push_back(conn);
+    return ret;
 }
 
 QList<QDataflowModelConnection*> QDataflowModel::findConnections(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet) const
 {
     if(!sourceNode || !destNode) return QList<QDataflowModelConnection*>();
-    QList<QDataflowModelConnection*> ret;
-    foreach(QDataflowModelConnection *conn, connections_)
-    {
-        QDataflowModelOutlet *src = conn->source();
-        QDataflowModelInlet *dst = conn->dest();
-        if(src->node() == sourceNode && src->index() == sourceOutlet && dst->node() == destNode && dst->index() == destInlet)
-            ret.push_back(conn);
-    }
-    return ret;
+    return findConnections(sourceNode->outlet(sourceOutlet), destNode->inlet(destInlet));
+}
+
+void QDataflowModel::onNodeValidChanged(QDataflowModelNode *node, bool valid)
+{
+    if(!contains(node) || isPending(node)) return;
+    emit nodeValidChanged(node, valid);
+}
+
+void QDataflowModel::onNodePosChanged(QDataflowModelNode *node, QPoint pos)
+{
+    if(!contains(node) || isPending(node)) return;
+    emit nodePosChanged(node, pos);
 }
 
-void QDataflowModel::onValidChanged(bool valid)
+void QDataflowModel::onNodeTextChanged(QDataflowModelNode *node, QString text)
 {
-    if(QDataflowModelNode *node = dynamic_cast<QDataflowModelNode*>(sender()))
-        emit nodeValidChanged(node, valid);
+    if(!contains(node) || isPending(node)) return;
+    emit nodeTextChanged(node, text);
 }
 
-void QDataflowModel::onPosChanged(QPoint pos)
+void QDataflowModel::onNodeInletCountChanged(QDataflowModelNode *node, int count)
 {
-    if(QDataflowModelNode *node = dynamic_cast<QDataflowModelNode*>(sender()))
-        emit nodePosChanged(node, pos);
+    if(!contains(node) || isPending(node)) return;
+    emit nodeInletCountChanged(node, count);
 }
 
-void QDataflowModel::onTextChanged(QString text)
+void QDataflowModel::onNodeOutletCountChanged(QDataflowModelNode *node, int count)
 {
-    if(QDataflowModelNode *node = dynamic_cast<QDataflowModelNode*>(sender()))
-        emit nodeTextChanged(node, text);
+    if(!contains(node) || isPending(node)) return;
+    emit nodeOutletCountChanged(node, count);
 }
 
-void QDataflowModel::onInletCountChanged(int count)
+void QDataflowModel::onNodeInletTypeChanged(QDataflowModelNode *node, int index, QString type)
 {
-    if(QDataflowModelNode *node = dynamic_cast<QDataflowModelNode*>(sender()))
-        emit nodeInletCountChanged(node, count);
+    if(!contains(node) || isPending(node)) return;
+    emit nodeInletTypeChanged(node, index, type);
 }
 
-void QDataflowModel::onOutletCountChanged(int count)
+void QDataflowModel::onNodeOutletTypeChanged(QDataflowModelNode *node, int index, QString type)
 {
-    if(QDataflowModelNode *node = dynamic_cast<QDataflowModelNode*>(sender()))
-        emit nodeOutletCountChanged(node, count);
+    if(!contains(node) || isPending(node)) return;
+    emit nodeOutletTypeChanged(node, index, type);
 }
 
 QDataflowModelNode::QDataflowModelNode(QDataflowModel *parent, QPoint pos, QString text, int inletCount, int outletCount)
-    : QObject(parent), valid_(false), pos_(pos), text_(text), dataflowMetaObject_(0L)
+    : QObject(parent), id_(-1), valid_(false), pos_(pos), text_(text), dataflowMetaObject_(0L),
+      subpatch_(0L), threadGroup_(0)
 {
     for(int i = 0; i < inletCount; i++) addInlet();
     for(int i = 0; i < outletCount; i++) addOutlet();
 }
 
 QDataflowModelNode::QDataflowModelNode(QDataflowModel *parent, QPoint pos, QString text, QStringList inletTypes, QStringList outletTypes)
-    : QObject(parent), valid_(false), pos_(pos), text_(text), dataflowMetaObject_(0L)
+    : QObject(parent), id_(-1), valid_(false), pos_(pos), text_(text), dataflowMetaObject_(0L),
+      subpatch_(0L), threadGroup_(0)
+{
+    foreach(const QString &inletType, inletTypes) addInlet("", inletType);
+    foreach(const QString &outletType, outletTypes) addOutlet("", outletType);
+}
+
+QDataflowModelNode::~QDataflowModelNode()
+{
+    // the meta object may still be using the subpatch
+    if(dataflowMetaObject_)
+        delete dataflowMetaObject_;
+    if(subpatch_)
+        delete subpatch_;
+}
+
+void * QDataflowModelNode::operator new(size_t size)
+{
+    return QDataflowPool<QDataflowModelNode>::instance().allocate(size);
+}
+
+void QDataflowModelNode::operator delete(void *p, size_t size)
 {
-    foreach(const QString &inletType, inletTypes) addInlet(inletType);
-    foreach(const QString &outletType, outletTypes) addOutlet(outletType);
+    QDataflowPool<QDataflowModelNode>::instance().deallocate(p, size);
 }
 
 QDataflowModel * QDataflowModelNode::model()
@@ -217,6 +822,11 @@ QDataflowModel * QDataflowModelNode::model()
     return static_cast<QDataflowModel*>(parent());
 }
 
+int QDataflowModelNode::id() const
+{
+    return id_;
+}
+
 QDataflowMetaObject * QDataflowModelNode::dataflowMetaObject() const
 {
     return dataflowMetaObject_;
@@ -224,6 +834,9 @@ QDataflowMetaObject * QDataflowModelNode::dataflowMetaObject() const
 
 void QDataflowModelNode::setDataflowMetaObject(QDataflowMetaObject *dataflowMetaObject)
 {
+    // the old meta object may be running
+    if(model()) model()->waitForIdle();
+
     if(dataflowMetaObject_)
         delete dataflowMetaObject_;
 
@@ -231,6 +844,20 @@ void QDataflowModelNode::setDataflowMetaObject(QDataflowMetaObject *dataflowMeta
 
     if(dataflowMetaObject_)
         dataflowMetaObject_->node_ = this;
+
+    if(model()) model()->invalidateExecutionPlan();
+}
+
+QDataflowSubpatch * QDataflowModelNode::subpatch() const
+{
+    return subpatch_;
+}
+
+QDataflowSubpatch * QDataflowModelNode::makeSubpatch()
+{
+    if(!subpatch_)
+        subpatch_ = new QDataflowSubpatch(this);
+    return subpatch_;
 }
 
 bool QDataflowModelNode::isValid() const
@@ -248,81 +875,131 @@ QString QDataflowModelNode::text() const
     return text_;
 }
 
-QList<QDataflowModelInlet*> QDataflowModelNode::inlets() const
+QList<QDataflowModelInlet> QDataflowModelNode::inlets() const
 {
-    return inlets_;
+    QList<QDataflowModelInlet> ret;
+    for(int i = 0; i < inlets_.size(); i++)
+        ret.push_back(QDataflowModelInlet(const_cast<QDataflowModelNode*>(this), i));
+    return ret;
 }
 
-QDataflowModelInlet * QDataflowModelNode::inlet(int index) const
+QDataflowModelInlet QDataflowModelNode::inlet(int index) const
 {
-    if(index >= 0 && index < inlets_.length())
-        return inlets_[index];
+    if(index >= 0 && index < inlets_.size())
+        return QDataflowModelInlet(const_cast<QDataflowModelNode*>(this), index);
     else
-        return 0L;
+        return QDataflowModelInlet();
 }
 
 int QDataflowModelNode::inletCount() const
 {
-    return inlets_.length();
+    return inlets_.size();
 }
 
-QList<QDataflowModelOutlet*> QDataflowModelNode::outlets() const
+QList<QDataflowModelOutlet> QDataflowModelNode::outlets() const
 {
-    return outlets_;
+    QList<QDataflowModelOutlet> ret;
+    for(int i = 0; i < outlets_.size(); i++)
+        ret.push_back(QDataflowModelOutlet(const_cast<QDataflowModelNode*>(this), i));
+    return ret;
 }
 
-QDataflowModelOutlet * QDataflowModelNode::outlet(int index) const
+QDataflowModelOutlet QDataflowModelNode::outlet(int index) const
 {
-    if(index >= 0 && index < outlets_.length())
-        return outlets_[index];
+    if(index >= 0 && index < outlets_.size())
+        return QDataflowModelOutlet(const_cast<QDataflowModelNode*>(this), index);
     else
-        return 0L;
+        return QDataflowModelOutlet();
 }
 
 int QDataflowModelNode::outletCount() const
 {
-    return outlets_.length();
+    return outlets_.size();
+}
+
+QVector<int> QDataflowModelNode::inletTypeIds() const
+{
+    QVector<int> ret;
+    ret.reserve(inlets_.size());
+    foreach(const IOlet &inlet, inlets_)
+        ret.push_back(inlet.type);
+    return ret;
+}
+
+QVector<int> QDataflowModelNode::outletTypeIds() const
+{
+    QVector<int> ret;
+    ret.reserve(outlets_.size());
+    foreach(const IOlet &outlet, outlets_)
+        ret.push_back(outlet.type);
+    return ret;
+}
+
+int QDataflowModelNode::threadGroup() const
+{
+    return threadGroup_;
+}
+
+void QDataflowModelNode::setThreadGroup(int group)
+{
+    if(threadGroup_ == group) return;
+    threadGroup_ = group;
+    if(model()) model()->invalidateExecutionPlan();
 }
 
 void QDataflowModelNode::setValid(bool valid)
 {
     if(valid_ == valid) return;
     valid_ = valid;
-    emit validChanged(valid);
+    notifyValidChanged();
 }
 
 void QDataflowModelNode::setPos(QPoint pos)
 {
     if(pos_ == pos) return;
+    QDataflowUndoGroup undoGroup(model());
+    QPoint oldPos = pos_;
     pos_ = pos;
-    emit posChanged(pos);
+    if(QDataflowUndoJournal *journal = undoJournal())
+        journal->recordNodeMoved(this, oldPos);
+    notifyPosChanged();
 }
 
 void QDataflowModelNode::setText(const QString &text)
 {
     if(text_ == text) return;
+    QDataflowUndoGroup undoGroup(model());
+    QString oldText = text_;
     text_ = text;
-    emit textChanged(text);
+    if(QDataflowUndoJournal *journal = undoJournal())
+        journal->recordNodeTextChanged(this, oldText);
+    notifyTextChanged();
 }
 
 void QDataflowModelNode::addInlet(QString name, QString type)
 {
-    addInlet(new QDataflowModelInlet(this, inletCount(), name, type));
+    QDataflowUndoPortsGroup undoGroup(this, true);
+    IOlet inlet;
+    inlet.name = name;
+    inlet.type = QDataflowTypeRegistry::instance()->intern(type);
+    inlets_.append(inlet);
+    notifyInletCountChanged();
 }
 
 void QDataflowModelNode::removeLastInlet()
 {
     if(inlets_.isEmpty()) return;
-    QDataflowModelInlet *inlet = inlets_.back();
-    foreach(QDataflowModelConnection *conn, inlet->connections())
+    QDataflowUndoPortsGroup undoGroup(this, true);
+    foreach(QDataflowModelConnection *conn, inlets_.back().connections)
         model()->disconnect(conn);
     inlets_.pop_back();
-    emit inletCountChanged(inletCount());
+    notifyInletCountChanged();
 }
 
 void QDataflowModelNode::setInletCount(int count)
 {
     if(inletCount() == count) return;
+    QDataflowUndoPortsGroup undoGroup(this, true);
 
     bool shouldBlockSignals = blockSignals(true);
 
@@ -334,26 +1011,45 @@ void QDataflowModelNode::setInletCount(int count)
 
     blockSignals(shouldBlockSignals);
 
-    emit inletCountChanged(count);
+    notifyInletCountChanged();
 }
 
 void QDataflowModelNode::setInletTypes(QStringList types)
 {
+    // only touch the ports that really change: ports that keep their type
+    // keep also their connections, and a retyped port loses only the
+    // connections that are no longer compatible
+
+    QDataflowUndoPortsGroup undoGroup(this, true);
+    QDataflowTypeRegistry *registry = QDataflowTypeRegistry::instance();
     int oldCount = inletCount();
+    QList<int> retyped;
 
     bool shouldBlockSignals = blockSignals(true);
 
-    while(inletCount() > 0)
+    while(inletCount() > types.size())
         removeLastInlet();
 
-    foreach(const QString &type, types)
-        addInlet("", type);
+    for(int i = 0; i < inletCount(); i++)
+    {
+        int type = registry->intern(types[i]);
+        if(inlets_[i].type == type) continue;
+        inlets_[i].type = type;
+        retyped.push_back(i);
+        foreach(QDataflowModelConnection *conn, inlets_[i].connections)
+            if(model() && !registry->isCompatible(conn->source().typeId(), type))
+                model()->disconnect(conn);
+    }
+
+    for(int i = inletCount(); i < types.size(); i++)
+        addInlet("", types[i]);
 
     blockSignals(shouldBlockSignals);
 
-    int newCount = inletCount();
-    if(oldCount != newCount)
-        emit inletCountChanged(newCount);
+    if(oldCount != inletCount())
+        notifyInletCountChanged();
+    foreach(int i, retyped)
+        notifyInletTypeChanged(i);
 }
 
 void QDataflowModelNode::setInletTypes(std::initializer_list<const char*> types_)
@@ -370,22 +1066,28 @@ void QDataflowModelNode::setInletTypes(std::initializer_list<const char*> types_
 
 void QDataflowModelNode::addOutlet(QString name, QString type)
 {
-    addOutlet(new QDataflowModelOutlet(this, outletCount(), name, type));
+    QDataflowUndoPortsGroup undoGroup(this, false);
+    IOlet outlet;
+    outlet.name = name;
+    outlet.type = QDataflowTypeRegistry::instance()->intern(type);
+    outlets_.append(outlet);
+    notifyOutletCountChanged();
 }
 
 void QDataflowModelNode::removeLastOutlet()
 {
     if(outlets_.isEmpty()) return;
-    QDataflowModelOutlet *outlet = outlets_.back();
-    foreach(QDataflowModelConnection *conn, outlet->connections())
+    QDataflowUndoPortsGroup undoGroup(this, false);
+    foreach(QDataflowModelConnection *conn, outlets_.back().connections)
         model()->disconnect(conn);
     outlets_.pop_back();
-    emit outletCountChanged(outletCount());
+    notifyOutletCountChanged();
 }
 
 void QDataflowModelNode::setOutletCount(int count)
 {
     if(outletCount() == count) return;
+    QDataflowUndoPortsGroup undoGroup(this, false);
 
     bool shouldBlockSignals = blockSignals(true);
 
@@ -397,26 +1099,45 @@ void QDataflowModelNode::setOutletCount(int count)
 
     blockSignals(shouldBlockSignals);
 
-    emit outletCountChanged(count);
+    notifyOutletCountChanged();
 }
 
 void QDataflowModelNode::setOutletTypes(QStringList types)
 {
+    // only touch the ports that really change: ports that keep their type
+    // keep also their connections, and a retyped port loses only the
+    // connections that are no longer compatible
+
+    QDataflowUndoPortsGroup undoGroup(this, false);
+    QDataflowTypeRegistry *registry = QDataflowTypeRegistry::instance();
     int oldCount = outletCount();
+    QList<int> retyped;
 
     bool shouldBlockSignals = blockSignals(true);
 
-    while(outletCount() > 0)
+    while(outletCount() > types.size())
         removeLastOutlet();
 
-    foreach(const QString &type, types)
-        addOutlet("", type);
+    for(int i = 0; i < outletCount(); i++)
+    {
+        int type = registry->intern(types[i]);
+        if(outlets_[i].type == type) continue;
+        outlets_[i].type = type;
+        retyped.push_back(i);
+        foreach(QDataflowModelConnection *conn, outlets_[i].connections)
+            if(model() && !registry->isCompatible(type, conn->dest().typeId()))
+                model()->disconnect(conn);
+    }
+
+    for(int i = outletCount(); i < types.size(); i++)
+        addOutlet("", types[i]);
 
     blockSignals(shouldBlockSignals);
 
-    int newCount = outletCount();
-    if(oldCount != newCount)
-        emit outletCountChanged(newCount);
+    if(oldCount != outletCount())
+        notifyOutletCountChanged();
+    foreach(int i, retyped)
+        notifyOutletTypeChanged(i);
 }
 
 void QDataflowModelNode::setOutletTypes(std::initializer_list<const char *> types_)
@@ -431,20 +1152,73 @@ void QDataflowModelNode::setOutletTypes(std::initializer_list<const char *> type
     setOutletTypes(types);
 }
 
-void QDataflowModelNode::addInlet(QDataflowModelInlet *inlet)
+QDataflowUndoJournal * QDataflowModelNode::undoJournal()
 {
-    if(!inlet) return;
-    inlet->setParent(this);
-    inlets_.append(inlet);
+    // changes to nodes not (yet) in the model are not recorded
+    if(!model() || !model()->contains(this)) return 0L;
+    return model()->undoJournal();
+}
+
+void QDataflowModelNode::notifyValidChanged()
+{
+    if(model()) model()->touchNode(id_);
+    emit validChanged(valid_);
+    if(!signalsBlocked() && model())
+        model()->onNodeValidChanged(this, valid_);
+}
+
+void QDataflowModelNode::notifyPosChanged()
+{
+    if(model()) model()->touchNode(id_);
+    emit posChanged(pos_);
+    if(!signalsBlocked() && model())
+        model()->onNodePosChanged(this, pos_);
+}
+
+void QDataflowModelNode::notifyTextChanged()
+{
+    if(model()) model()->touchNode(id_);
+    emit textChanged(text_);
+    if(!signalsBlocked() && model())
+        model()->onNodeTextChanged(this, text_);
+}
+
+void QDataflowModelNode::notifyInletCountChanged()
+{
+    if(model()) model()->touchNode(id_);
     emit inletCountChanged(inletCount());
+    if(!signalsBlocked() && model())
+        model()->onNodeInletCountChanged(this, inletCount());
 }
 
-void QDataflowModelNode::addOutlet(QDataflowModelOutlet *outlet)
+void QDataflowModelNode::notifyOutletCountChanged()
 {
-    if(!outlet) return;
-    outlet->setParent(this);
-    outlets_.append(outlet);
+    if(model())
+    {
+        model()->touchNode(id_);
+        model()->invalidateExecutionPlan();
+    }
     emit outletCountChanged(outletCount());
+    if(!signalsBlocked() && model())
+        model()->onNodeOutletCountChanged(this, outletCount());
+}
+
+void QDataflowModelNode::notifyInletTypeChanged(int index)
+{
+    if(model()) model()->touchNode(id_);
+    QString type = inlet(index).type();
+    emit inletTypeChanged(index, type);
+    if(!signalsBlocked() && model())
+        model()->onNodeInletTypeChanged(this, index, type);
+}
+
+void QDataflowModelNode::notifyOutletTypeChanged(int index)
+{
+    if(model()) model()->touchNode(id_);
+    QString type = outlet(index).type();
+    emit outletTypeChanged(index, type);
+    if(!signalsBlocked() && model())
+        model()->onNodeOutletTypeChanged(this, index, type);
 }
 
 QDebug operator<<(QDebug debug, const QDataflowModelNode &node)
@@ -452,7 +1226,7 @@ QDebug operator<<(QDebug debug, const QDataflowModelNode &node)
     QDebugStateSaver stateSaver(debug);
     debug.nospace() << "QDataflowModelNode";
     debug.nospace() << "(" << reinterpret_cast<const void*>(&node) <<
-                       ", text=" << node.text() << ")";
+                       ", id=" << node.id() << ", text=" << node.text() << ")";
     return debug;
 }
 
@@ -461,102 +1235,105 @@ QDebug operator<<(QDebug debug, const QDataflowModelNode *node)
     return debug << *node;
 }
 
-QDataflowModelIOlet::QDataflowModelIOlet(QDataflowModelNode *parent, int index, QString name, QString type)
-    : QObject(parent), node_(parent), index_(index), name_(name), type_(type)
+QDataflowModel * QDataflowModelIOlet::model() const
 {
-
+    return node_ ? node_->model() : 0L;
 }
 
-QDataflowModel * QDataflowModelIOlet::model()
+uint qHash(const QDataflowModelIOlet &iolet, uint seed)
 {
-    return node_->model();
+    return qHash(iolet.node(), seed) ^ uint(iolet.index());
 }
 
-QDataflowModelNode * QDataflowModelIOlet::node() const
+bool QDataflowModelInlet::isValid() const
 {
-    return node_;
+    return node_ && index_ >= 0 && index_ < node_->inlets_.size();
 }
 
-int QDataflowModelIOlet::index() const
+QString QDataflowModelInlet::name() const
 {
-    return index_;
+    return node_->inlets_[index_].name;
 }
 
-QString QDataflowModelIOlet::type() const
+QString QDataflowModelInlet::type() const
 {
-    return type_;
+    return QDataflowTypeRegistry::instance()->name(node_->inlets_[index_].type);
 }
 
-void QDataflowModelIOlet::addConnection(QDataflowModelConnection *conn)
+int QDataflowModelInlet::typeId() const
 {
-    connections_.push_back(conn);
+    return node_->inlets_[index_].type;
 }
 
-void QDataflowModelIOlet::removeConnection(QDataflowModelConnection *conn)
+QVector<QDataflowModelConnection*> QDataflowModelInlet::connections() const
 {
-    connections_.removeAll(conn);
+    return node_->inlets_[index_].connections;
 }
 
-QList<QDataflowModelConnection*> QDataflowModelIOlet::connections() const
+bool QDataflowModelInlet::canAcceptConnectionFrom(const QDataflowModelOutlet &outlet) const
 {
-    return connections_;
+    return QDataflowTypeRegistry::instance()->isCompatible(outlet.typeId(), typeId());
 }
 
-QDataflowModelInlet::QDataflowModelInlet(QDataflowModelNode *parent, int index, QString name, QString type)
-    : QDataflowModelIOlet(parent, index, name, type)
+QDebug operator<<(QDebug debug, const QDataflowModelInlet &inlet)
 {
-
+    QDebugStateSaver stateSaver(debug);
+    debug.nospace() << "QDataflowModelInlet";
+    debug.nospace() << "(node=" << inlet.node() << ", index=" << inlet.index() << ", type=" << inlet.type() << ")";
+    return debug;
 }
 
-bool QDataflowModelInlet::canAcceptConnectionFrom(QDataflowModelOutlet *outlet)
+bool QDataflowModelOutlet::isValid() const
 {
-    if(type() == "*") return true;
-    return type() == outlet->type();
+    return node_ && index_ >= 0 && index_ < node_->outlets_.size();
 }
 
-QDebug operator<<(QDebug debug, const QDataflowModelInlet &inlet)
+QString QDataflowModelOutlet::name() const
 {
-    QDebugStateSaver stateSaver(debug);
-    debug.nospace() << "QDataflowModelInlet";
-    debug.nospace() << "(" << reinterpret_cast<const void*>(&inlet) <<
-                       ", node=" << inlet.node() << ", index=" << inlet.index() << ", type=" << inlet.type() << ")";
-    return debug;
+    return node_->outlets_[index_].name;
 }
 
-QDebug operator<<(QDebug debug, const QDataflowModelInlet *inlet)
+QString QDataflowModelOutlet::type() const
 {
-    return debug << *inlet;
+    return QDataflowTypeRegistry::instance()->name(node_->outlets_[index_].type);
 }
 
-QDataflowModelOutlet::QDataflowModelOutlet(QDataflowModelNode *parent, int index, QString name, QString type)
-    : QDataflowModelIOlet(parent, index, name, type)
+int QDataflowModelOutlet::typeId() const
 {
+    return node_->outlets_[index_].type;
+}
 
+QVector<QDataflowModelConnection*> QDataflowModelOutlet::connections() const
+{
+    return node_->outlets_[index_].connections;
 }
 
-bool QDataflowModelOutlet::canMakeConnectionTo(QDataflowModelInlet *inlet)
+bool QDataflowModelOutlet::canMakeConnectionTo(const QDataflowModelInlet &inlet) const
 {
-    if(inlet->type() == "*") return true;
-    return type() == inlet->type();
+    return QDataflowTypeRegistry::instance()->isCompatible(typeId(), inlet.typeId());
 }
 
 QDebug operator<<(QDebug debug, const QDataflowModelOutlet &outlet)
 {
     QDebugStateSaver stateSaver(debug);
     debug.nospace() << "QDataflowModelOutlet";
-    debug.nospace() << "(" << reinterpret_cast<const void*>(&outlet) <<
-                       ", node=" << outlet.node() << ", index=" << outlet.index() << ", type=" << outlet.type() << ")";
+    debug.nospace() << "(node=" << outlet.node() << ", index=" << outlet.index() << ", type=" << outlet.type() << ")";
     return debug;
 }
 
-QDebug operator<<(QDebug debug, const QDataflowModelOutlet *outlet)
+QDataflowModelConnection::QDataflowModelConnection(QDataflowModel *parent, const QDataflowModelOutlet &source, const QDataflowModelInlet &dest)
+    : QObject(parent), id_(-1), source_(source), dest_(dest), transport_(Auto)
 {
-    return debug << *outlet;
 }
 
-QDataflowModelConnection::QDataflowModelConnection(QDataflowModel *parent, QDataflowModelOutlet *source, QDataflowModelInlet *dest)
-    : QObject(parent), source_(source), dest_(dest)
+void * QDataflowModelConnection::operator new(size_t size)
 {
+    return QDataflowPool<QDataflowModelConnection>::instance().allocate(size);
+}
+
+void QDataflowModelConnection::operator delete(void *p, size_t size)
+{
+    QDataflowPool<QDataflowModelConnection>::instance().deallocate(p, size);
 }
 
 QDataflowModel * QDataflowModelConnection::model()
@@ -564,22 +1341,46 @@ QDataflowModel * QDataflowModelConnection::model()
     return static_cast<QDataflowModel*>(parent());
 }
 
-QDataflowModelOutlet * QDataflowModelConnection::source() const
+int QDataflowModelConnection::id() const
+{
+    return id_;
+}
+
+QDataflowModelOutlet QDataflowModelConnection::source() const
 {
     return source_;
 }
 
-QDataflowModelInlet * QDataflowModelConnection::dest() const
+QDataflowModelInlet QDataflowModelConnection::dest() const
 {
     return dest_;
 }
 
+QDataflowModelConnection::Transport QDataflowModelConnection::transport() const
+{
+    return transport_;
+}
+
+void QDataflowModelConnection::setTransport(Transport transport)
+{
+    if(transport_ == transport) return;
+    transport_ = transport;
+    if(model()) model()->invalidateExecutionPlan();
+}
+
+bool QDataflowModelConnection::isQueued() const
+{
+    if(transport_ == Auto)
+        return source_.node()->threadGroup() != dest_.node()->threadGroup();
+    return transport_ == Queued;
+}
+
 QDebug operator<<(QDebug debug, const QDataflowModelConnection &conn)
 {
     QDebugStateSaver stateSaver(debug);
     debug.nospace() << "QDataflowModelConnection";
     debug.nospace() << "(" << reinterpret_cast<const void*>(&conn) <<
-                       ", src=" << conn.source() << ", dst=" << conn.dest() << ")";
+                       ", id=" << conn.id() << ", src=" << conn.source() << ", dst=" << conn.dest() << ")";
     return debug;
 }
 
@@ -593,20 +1394,43 @@ QDataflowMetaObject::QDataflowMetaObject(QDataflowModelNode *node)
 {
 }
 
-void QDataflowMetaObject::onDataReceved(int inlet, void *data)
+void QDataflowMetaObject::onDataReceved(int inlet, const QDataflowMessage &message)
 {
     Q_UNUSED(inlet);
-    Q_UNUSED(data);
+    Q_UNUSED(message);
 }
 
-void QDataflowMetaObject::sendData(int outletIndex, void *data)
+void QDataflowMetaObject::processBlock(int inlet, const float *samples, int n)
 {
-    foreach(QDataflowModelConnection *conn, outlet(outletIndex)->connections())
+    for(int i = 0; i < n; i++)
+        onDataReceved(inlet, double(samples[i]));
+}
+
+void QDataflowMetaObject::receive(int inlet, const QDataflowMessage &message)
+{
+    if(message.type() == QDataflowMessage::Samples && !forwardsBlocks())
     {
-        QDataflowMetaObject *mo = conn->dest()->node()->dataflowMetaObject();
-        if(mo)
-            mo->onDataReceved(conn->dest()->index(), data);
+        const QVector<float> &samples = message.samplesRef();
+        processBlock(inlet, samples.constData(), samples.size());
     }
+    else onDataReceved(inlet, message);
+}
+
+void QDataflowMetaObject::sendData(int outletIndex, const QDataflowMessage &message)
+{
+    QDataflowModel *model = node_->model();
+    if(!model) return;
+    if(QDataflowExecutor *executor = model->executor())
+        executor->send(node_->id(), outletIndex, message);
+    else
+        QDataflowScheduler::instance()->send(model, node_->id(), outletIndex, message);
+}
+
+void QDataflowMetaObject::sendBlock(int outletIndex, const float *samples, int n)
+{
+    QVector<float> block(n);
+    std::copy(samples, samples + n, block.begin());
+    sendData(outletIndex, std::move(block));
 }
 
 QDataflowModelDebugSignals::QDataflowModelDebugSignals(QDataflowModel *parent)
@@ -618,8 +1442,14 @@ QDataflowModelDebugSignals::QDataflowModelDebugSignals(QDataflowModel *parent)
     QObject::connect(parent, &QDataflowModel::nodeTextChanged, this, &QDataflowModelDebugSignals::onNodeTextChanged);
     QObject::connect(parent, &QDataflowModel::nodeInletCountChanged, this, &QDataflowModelDebugSignals::onNodeInletCountChanged);
     QObject::connect(parent, &QDataflowModel::nodeOutletCountChanged, this, &QDataflowModelDebugSignals::onNodeOutletCountChanged);
+    QObject::connect(parent, &QDataflowModel::nodeInletTypeChanged, this, &QDataflowModelDebugSignals::onNodeInletTypeChanged);
+    QObject::connect(parent, &QDataflowModel::nodeOutletTypeChanged, this, &QDataflowModelDebugSignals::onNodeOutletTypeChanged);
     QObject::connect(parent, &QDataflowModel::connectionAdded, this, &QDataflowModelDebugSignals::onConnectionAdded);
     QObject::connect(parent, &QDataflowModel::connectionRemoved, this, &QDataflowModelDebugSignals::onConnectionRemoved);
+    QObject::connect(parent, &QDataflowModel::nodesAdded, this, &QDataflowModelDebugSignals::onNodesAdded);
+    QObject::connect(parent, &QDataflowModel::nodesRemoved, this, &QDataflowModelDebugSignals::onNodesRemoved);
+    QObject::connect(parent, &QDataflowModel::connectionsAdded, this, &QDataflowModelDebugSignals::onConnectionsAdded);
+    QObject::connect(parent, &QDataflowModel::connectionsRemoved, this, &QDataflowModelDebugSignals::onConnectionsRemoved);
 }
 
 QDebug QDataflowModelDebugSignals::debug() const
@@ -657,6 +1487,16 @@ void QDataflowModelDebugSignals::onNodeOutletCountChanged(QDataflowModelNode *no
     debug() << "nodeOutletCountChanged" << node << count;
 }
 
+void QDataflowModelDebugSignals::onNodeInletTypeChanged(QDataflowModelNode *node, int index, QString type)
+{
+    debug() << "nodeInletTypeChanged" << node << index << type;
+}
+
+void QDataflowModelDebugSignals::onNodeOutletTypeChanged(QDataflowModelNode *node, int index, QString type)
+{
+    debug() << "nodeOutletTypeChanged" << node << index << type;
+}
+
 void QDataflowModelDebugSignals::onConnectionAdded(QDataflowModelConnection *conn)
 {
     debug() << "connectionAdded" << conn;
@@ -666,3 +1506,23 @@ void QDataflowModelDebugSignals::onConnectionRemoved(QDataflowModelConnection *c
 {
     debug() << "connectionRemoved" << conn;
 }
+
+void QDataflowModelDebugSignals::onNodesAdded(QList<QDataflowModelNode*> nodes)
+{
+    debug() << "nodesAdded" << nodes.size();
+}
+
+void QDataflowModelDebugSignals::onNodesRemoved(QList<QDataflowModelNode*> nodes)
+{
+    debug() << "nodesRemoved" << nodes.size();
+}
+
+void QDataflowModelDebugSignals::onConnectionsAdded(QList<QDataflowModelConnection*> conns)
+{
+    debug() << "connectionsAdded" << conns.size();
+}
+
+void QDataflowModelDebugSignals::onConnectionsRemoved(QList<QDataflowModelConnection*> conns)
+{
+    debug() << "connectionsRemoved" << conns.size();
+}
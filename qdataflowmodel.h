@@ -18,25 +18,143 @@
 #define QDATAFLOWMODEL_H
 
 #include <QObject>
+#include <QAtomicInt>
 #include <QSet>
 #include <QList>
+#include <QHash>
+#include <QVector>
+#include <QPair>
 #include <QPoint>
 #include <QString>
 #include <QStringList>
 #include <QDebug>
 
+#include "qdataflowexecutionplan.h"
+#include "qdataflowmessage.h"
+#include "qdataflowmodelsnapshot.h"
+#include "qdataflowtopology.h"
+
+class QDataflowModel;
 class QDataflowModelNode;
-class QDataflowModelIOlet;
-class QDataflowModelInlet;
-class QDataflowModelOutlet;
 class QDataflowModelConnection;
+class QDataflowExecutor;
 class QDataflowMetaObject;
+class QDataflowPipeline;
+class QDataflowSubpatch;
+class QDataflowUndoJournal;
+
+class QDataflowModelIOlet
+{
+protected:
+    QDataflowModelIOlet() : node_(0L), index_(-1) {}
+    QDataflowModelIOlet(QDataflowModelNode *node, int index) : node_(node), index_(index) {}
+
+public:
+    QDataflowModel * model() const;
+
+    QDataflowModelNode * node() const {return node_;}
+    int index() const {return index_;}
+
+    bool operator==(const QDataflowModelIOlet &other) const {return node_ == other.node_ && index_ == other.index_;}
+    bool operator!=(const QDataflowModelIOlet &other) const {return !(*this == other);}
+
+protected:
+    QDataflowModelNode *node_;
+    int index_;
+};
+
+uint qHash(const QDataflowModelIOlet &iolet, uint seed = 0);
+
+class QDataflowModelOutlet;
+
+class QDataflowModelInlet : public QDataflowModelIOlet
+{
+public:
+    QDataflowModelInlet() {}
+
+    bool isValid() const;
+    QString name() const;
+    QString type() const;
+    int typeId() const;
+    QVector<QDataflowModelConnection*> connections() const;
+
+    bool canAcceptConnectionFrom(const QDataflowModelOutlet &outlet) const;
+
+protected:
+    QDataflowModelInlet(QDataflowModelNode *node, int index) : QDataflowModelIOlet(node, index) {}
+
+    friend class QDataflowModelNode;
+};
+
+QDebug operator<<(QDebug debug, const QDataflowModelInlet &inlet);
+
+class QDataflowModelOutlet : public QDataflowModelIOlet
+{
+public:
+    QDataflowModelOutlet() {}
+
+    bool isValid() const;
+    QString name() const;
+    QString type() const;
+    int typeId() const;
+    QVector<QDataflowModelConnection*> connections() const;
+
+    bool canMakeConnectionTo(const QDataflowModelInlet &inlet) const;
+
+protected:
+    QDataflowModelOutlet(QDataflowModelNode *node, int index) : QDataflowModelIOlet(node, index) {}
+
+    friend class QDataflowModelNode;
+};
+
+QDebug operator<<(QDebug debug, const QDataflowModelOutlet &outlet);
+
+// Read-only view over the live items of a model, in ID (i.e. creation)
+// order; it does not copy anything, and is invalidated by any change to
+// the model.
+template<typename T>
+class QDataflowModelItemRange
+{
+public:
+    class const_iterator
+    {
+    public:
+        const_iterator() : p_(0L), end_(0L) {}
+        T * operator*() const {return *p_;}
+        const_iterator & operator++() {++p_; skip(); return *this;}
+        bool operator==(const const_iterator &other) const {return p_ == other.p_;}
+        bool operator!=(const const_iterator &other) const {return p_ != other.p_;}
+
+    private:
+        const_iterator(T * const *p, T * const *end) : p_(p), end_(end) {skip();}
+        void skip() {while(p_ != end_ && !*p_) ++p_;}
+
+        T * const *p_;
+        T * const *end_;
+
+        friend class QDataflowModelItemRange;
+    };
+
+    QDataflowModelItemRange(const QVector<T*> &items, int count)
+        : begin_(items.constData()), end_(items.constData() + items.size()), count_(count) {}
+
+    const_iterator begin() const {return const_iterator(begin_, end_);}
+    const_iterator end() const {return const_iterator(end_, end_);}
+    int size() const {return count_;}
+    bool isEmpty() const {return count_ == 0;}
+
+private:
+    T * const *begin_;
+    T * const *end_;
+    int count_;
+};
 
 class QDataflowModel : public QObject
 {
     Q_OBJECT
 public:
     explicit QDataflowModel(QObject *parent = 0);
+    virtual ~QDataflowModel();
 
 protected:
     virtual QDataflowModelNode * newNode(QPoint pos, QString text, int inletCount, int outletCount);
@@ -44,21 +162,113 @@ protected:
 
 public:
     virtual QDataflowModelNode * create(QPoint pos, QString text, int inletCount, int outletCount);
+    // removed nodes and connections are deleted (with deleteLater()) after
+    // the removal has been notified; don't keep pointers to them around
     virtual void remove(QDataflowModelNode *node);
     virtual QDataflowModelConnection * connect(QDataflowModelConnection *conn);
     virtual QDataflowModelConnection * connect(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet);
     virtual void disconnect(QDataflowModelConnection *conn);
     virtual void disconnect(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet);
+    // remove everything; outside of a transaction the removed objects are
+    // deleted right after being notified instead of with deleteLater()
+    virtual void clear();
 
+    // copy the given nodes (of this model) and the connections between them,
+    // moved by offset; the copies are reported with one nodesAdded and one
+    // connectionsAdded signal, and returned in the same order as nodes
+    QList<QDataflowModelNode*> cloneSubgraph(const QList<QDataflowModelNode*> &nodes, QPoint offset);
+
+    // nodes() and connections() return a copy; to walk the graph prefer
+    // nodeRange()/connectionRange(), or the ID-based accessors
     QSet<QDataflowModelNode*> nodes();
     QSet<QDataflowModelConnection*> connections();
+    QDataflowModelItemRange<QDataflowModelNode> nodeRange() const;
+    QDataflowModelItemRange<QDataflowModelConnection> connectionRange() const;
+    int nodeCount() const;
+    int connectionCount() const;
+    bool contains(QDataflowModelNode *node) const;
+    bool contains(QDataflowModelConnection *conn) const;
+
+    // IDs are assigned when an item is added to the model and are never
+    // reused by the same model; an ID of a removed item resolves to null
+    QDataflowModelNode * node(int id) const;
+    QDataflowModelConnection * connection(int id) const;
+    int nodeIdBound() const;
+    int connectionIdBound() const;
+
+    // see QDataflowUndoJournal
+    QDataflowUndoJournal * undoJournal() const;
+
+    // null unless messages are run by a QDataflowExecutor; removing nodes,
+    // replacing meta objects and any other change to the execution plan
+    // wait for it to be idle first
+    QDataflowExecutor * executor() const;
+    // null unless thread groups are run by a QDataflowPipeline; the same
+    // changes stop it (see QDataflowPipeline::start())
+    QDataflowPipeline * pipeline() const;
+
+    // immutable copy of the graph, safe to read from other threads; only
+    // the parts which changed since the previous snapshot are copied
+    QDataflowModelSnapshot snapshot() const;
+
+    // connections compiled into flat per-outlet arrays, used to dispatch
+    // messages; recompiled on demand after the topology has changed
+    const QDataflowExecutionPlan & executionPlan() const;
+    // incremented by any change affecting the execution plan; can be read
+    // from any thread
+    int topologyRevision() const;
+
+    // make room for adding the given number of nodes and connections
+    void reserve(int nodeCount, int connectionCount);
+
+    // Bulk construction, for loaders: between beginBulkInsert() and
+    // endBulkInsert() nodes (with their port types) and connections are
+    // appended directly, and endBulkInsert() rebuilds the topological order
+    // in one pass, invalidates the execution plan once and reports
+    // everything with nodesAdded and connectionsAdded. appendConnection()
+    // only refuses duplicates and incompatible types (returning null): the
+    // caller validates nodes and port indices. Bulk insertions are not
+    // recorded by the undo journal, which is cleared at the end (loading
+    // is not an edit).
+    void beginBulkInsert();
+    QDataflowModelNode * appendNode(QPoint pos, const QString &text, const QVector<int> &inletTypes, const QVector<int> &outletTypes);
+    QDataflowModelConnection * appendConnection(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet);
+    void endBulkInsert();
+
+    // Between beginUpdate() and endUpdate() the nodeAdded/nodeRemoved and
+    // connectionAdded/connectionRemoved signals are not emitted; the changes
+    // are queued and reported at the outermost endUpdate() with the batched
+    // nodesAdded/nodesRemoved/connectionsAdded/connectionsRemoved signals.
+    // Per-node change signals are not emitted for nodes that are still pending.
+    void beginUpdate();
+    void endUpdate();
+    bool isUpdating() const;
+
+    // The model keeps a topological order of its nodes, updated incrementally
+    // as connections are added and removed. If the graph has cycles, nodes
+    // of the same strongly connected component are grouped together, and
+    // components are in topological order.
+    QList<QDataflowModelNode*> topologicalOrder() const;
+    bool isAcyclic() const;
+    bool wouldCreateCycle(const QDataflowModelOutlet &outlet, const QDataflowModelInlet &inlet) const;
+    QList<QList<QDataflowModelNode*> > stronglyConnectedComponents() const;
+
+    // Nodes reachable from (downstream) or reaching (upstream) the given
+    // node(s), sorted by ID. The node itself is included only if it is part
+    // of a cycle. Results are cached, and invalidated incrementally as
+    // connections change; the list overloads compute uncached ones in parallel.
+    QList<QDataflowModelNode*> downstreamNodes(QDataflowModelNode *node) const;
+    QList<QDataflowModelNode*> upstreamNodes(QDataflowModelNode *node) const;
+    QList<QDataflowModelNode*> downstreamNodes(const QList<QDataflowModelNode*> &nodes) const;
+    QList<QDataflowModelNode*> upstreamNodes(const QList<QDataflowModelNode*> &nodes) const;
+    bool isReachable(QDataflowModelNode *source, QDataflowModelNode *dest) const;
 
 protected:
     virtual void addConnection(QDataflowModelConnection *conn);
     virtual void removeConnection(QDataflowModelConnection *conn);
     virtual QList<QDataflowModelConnection*> findConnections(QDataflowModelConnection *conn) const;
     virtual QList<QDataflowModelConnection*> findConnections(QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet) const;
-    virtual QList<QDataflowModelConnection*> findConnections(QDataflowModelOutlet *source, QDataflowModelInlet *dest) const;
+    virtual QList<QDataflowModelConnection*> findConnections(const QDataflowModelOutlet &source, const QDataflowModelInlet &dest) const;
 
 signals:
     void nodeAdded(QDataflowModelNode *node);
@@ -68,21 +278,93 @@ signals:
     void nodeTextChanged(QDataflowModelNode *node, QString text);
     void nodeInletCountChanged(QDataflowModelNode *node, int count);
     void nodeOutletCountChanged(QDataflowModelNode *node, int count);
+    void nodeInletTypeChanged(QDataflowModelNode *node, int index, QString type);
+    void nodeOutletTypeChanged(QDataflowModelNode *node, int index, QString type);
     void connectionAdded(QDataflowModelConnection *conn);
     void connectionRemoved(QDataflowModelConnection *conn);
+    void nodesAdded(QList<QDataflowModelNode*> nodes);
+    void nodesRemoved(QList<QDataflowModelNode*> nodes);
+    void connectionsAdded(QList<QDataflowModelConnection*> conns);
+    void connectionsRemoved(QList<QDataflowModelConnection*> conns);
+    // the nested model of a subpatch node has been created (and is
+    // about to be filled), see QDataflowSubpatch
+    void subpatchLoaded(QDataflowModelNode *node, QDataflowModel *subpatchModel);
 
 public slots:
 
-private slots:
-    virtual void onValidChanged(bool valid);
-    virtual void onPosChanged(QPoint pos);
-    virtual void onTextChanged(QString text);
-    virtual void onInletCountChanged(int count);
-    virtual void onOutletCountChanged(int count);
+protected:
+    // called directly by the nodes of this model when they change
+    virtual void onNodeValidChanged(QDataflowModelNode *node, bool valid);
+    virtual void onNodePosChanged(QDataflowModelNode *node, QPoint pos);
+    virtual void onNodeTextChanged(QDataflowModelNode *node, QString text);
+    virtual void onNodeInletCountChanged(QDataflowModelNode *node, int count);
+    virtual void onNodeOutletCountChanged(QDataflowModelNode *node, int count);
+    virtual void onNodeInletTypeChanged(QDataflowModelNode *node, int index, QString type);
+    virtual void onNodeOutletTypeChanged(QDataflowModelNode *node, int index, QString type);
 
 private:
-    QSet<QDataflowModelNode*> nodes_;
-    QSet<QDataflowModelConnection*> connections_;
+    bool isPending(QDataflowModelNode *node) const;
+    void addNode(QDataflowModelNode *node);
+    // re-create a node/connection with the ID it had before being removed
+    QDataflowModelNode * restoreNode(int id, QPoint pos, QString text, const QVector<int> &inletTypes, const QVector<int> &outletTypes);
+    QDataflowModelConnection * restoreConnection(int id, QDataflowModelNode *sourceNode, int sourceOutlet, QDataflowModelNode *destNode, int destInlet);
+    // add a connection known to be valid, compatible and not a duplicate,
+    // without invalidating the execution plan
+    void insertConnection(QDataflowModelConnection *conn);
+    QVector<int> nodeIds(const QList<QDataflowModelNode*> &nodes) const;
+    // mark a node/connection as changed since the last snapshot
+    void touchNode(int id);
+    void touchConnection(int id);
+    // wait until no meta object of this model is run by another thread
+    void waitForIdle();
+    void invalidateExecutionPlan();
+    QList<QDataflowModelNode*> nodesFromBits(const QBitArray &bits) const;
+
+    typedef QPair<QDataflowModelOutlet, QDataflowModelInlet> ConnectionKey;
+
+    QVector<QDataflowModelNode*> nodes_;
+    QVector<QDataflowModelConnection*> connections_;
+    int nodeCount_;
+    int connectionCount_;
+    QHash<ConnectionKey, QDataflowModelConnection*> connectionIndex_;
+    QDataflowTopology topology_;
+    // edges appended since beginBulkInsert()
+    QVector<QPair<int, int> > bulkEdges_;
+    int updateDepth_;
+    QList<QDataflowModelNode*> pendingNodesAdded_;
+    QSet<QDataflowModelNode*> pendingNodesAddedSet_;
+    QList<QDataflowModelNode*> pendingNodesRemoved_;
+    QList<QDataflowModelConnection*> pendingConnectionsAdded_;
+    QSet<QDataflowModelConnection*> pendingConnectionsAddedSet_;
+    QList<QDataflowModelConnection*> pendingConnectionsRemoved_;
+    QDataflowUndoJournal *undoJournal_;
+    QDataflowExecutor *executor_;
+    QDataflowPipeline *pipeline_;
+    mutable QDataflowModelSnapshot snapshot_;
+    mutable QBitArray dirtyNodeChunks_;
+    mutable QBitArray dirtyConnectionChunks_;
+    mutable bool snapshotDirty_;
+    QAtomicInt topologyRevision_;
+    mutable QDataflowExecutionPlan executionPlan_;
+
+    friend class QDataflowModelNode;
+    friend class QDataflowModelConnection;
+    friend class QDataflowModelDiff;
+    friend class QDataflowExecutor;
+    friend class QDataflowPipeline;
+    friend class QDataflowUndoJournal;
+};
+
+class QDataflowModelUpdateGuard
+{
+public:
+    explicit QDataflowModelUpdateGuard(QDataflowModel *model) : model_(model) {model_->beginUpdate();}
+    ~QDataflowModelUpdateGuard() {model_->endUpdate();}
+
+private:
+    Q_DISABLE_COPY(QDataflowModelUpdateGuard)
+
+    QDataflowModel *model_;
 };
 
 class QDataflowModelNode : public QObject
@@ -93,21 +375,40 @@ protected:
     explicit QDataflowModelNode(QDataflowModel *parent, QPoint pos, QString text, QStringList inletTypes, QStringList outletTypes);
 
 public:
+    virtual ~QDataflowModelNode();
+
+    static void * operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
     QDataflowModel * model();
+    int id() const;
 
     QDataflowMetaObject * dataflowMetaObject() const;
     void setDataflowMetaObject(QDataflowMetaObject *dataflowMetaObject);
 
+    // null unless this is a subpatch node; makeSubpatch() turns the node
+    // into one (with empty contents) if it isn't already
+    QDataflowSubpatch * subpatch() const;
+    QDataflowSubpatch * makeSubpatch();
+
     bool isValid() const;
     void setValid(bool valid);
     QPoint pos() const;
     QString text() const;
-    QList<QDataflowModelInlet*> inlets() const;
-    QDataflowModelInlet * inlet(int index) const;
+    QList<QDataflowModelInlet> inlets() const;
+    QDataflowModelInlet inlet(int index) const;
     int inletCount() const;
-    QList<QDataflowModelOutlet*> outlets() const;
-    QDataflowModelOutlet * outlet(int index) const;
+    QList<QDataflowModelOutlet> outlets() const;
+    QDataflowModelOutlet outlet(int index) const;
     int outletCount() const;
+    // interned types (see QDataflowTypeRegistry)
+    QVector<int> inletTypeIds() const;
+    QVector<int> outletTypeIds() const;
+
+    // nodes of the same nonzero group are run by the same thread of a
+    // QDataflowPipeline; 0 (the default) means not pinned to a thread
+    int threadGroup() const;
+    void setThreadGroup(int group);
 
 signals:
     void validChanged(bool valid);
@@ -115,6 +416,8 @@ signals:
     void textChanged(QString text);
     void inletCountChanged(int count);
     void outletCountChanged(int count);
+    void inletTypeChanged(int index, QString type);
+    void outletTypeChanged(int index, QString type);
 
 public slots:
     void setPos(QPoint pos);
@@ -130,115 +433,83 @@ public slots:
     void setOutletTypes(QStringList types);
     void setOutletTypes(std::initializer_list<const char *> types);
 
-protected slots:
-    void addInlet(QDataflowModelInlet *inlet);
-    void addOutlet(QDataflowModelOutlet *outlet);
-
 private:
+    // inlets and outlets are plain values stored contiguously in the node;
+    // QDataflowModelInlet/QDataflowModelOutlet are (node, index) handles to them
+    struct IOlet
+    {
+        QString name;
+        int type; // see QDataflowTypeRegistry
+        QVector<QDataflowModelConnection*> connections;
+    };
+
+    QDataflowUndoJournal * undoJournal();
+
+    void notifyValidChanged();
+    void notifyPosChanged();
+    void notifyTextChanged();
+    void notifyInletCountChanged();
+    void notifyOutletCountChanged();
+    void notifyInletTypeChanged(int index);
+    void notifyOutletTypeChanged(int index);
+
+    int id_;
     bool valid_;
     QPoint pos_;
     QString text_;
-    QList<QDataflowModelInlet*> inlets_;
-    QList<QDataflowModelOutlet*> outlets_;
+    QVector<IOlet> inlets_;
+    QVector<IOlet> outlets_;
     QDataflowMetaObject *dataflowMetaObject_;
+    QDataflowSubpatch *subpatch_;
+    int threadGroup_;
 
     friend class QDataflowModel;
+    friend class QDataflowModelIOlet;
+    friend class QDataflowModelInlet;
+    friend class QDataflowModelOutlet;
+    friend class QDataflowBinaryFormat;
+    friend class QDataflowExecutionPlan;
+    friend class QDataflowUndoJournal;
 };
 
 QDebug operator<<(QDebug debug, const QDataflowModelNode &node);
 QDebug operator<<(QDebug debug, const QDataflowModelNode *node);
 
-class QDataflowModelIOlet : public QObject
-{
-    Q_OBJECT
-protected:
-    explicit QDataflowModelIOlet(QDataflowModelNode *parent, int index, QString name = "", QString type = "*");
-
-public:
-    QDataflowModel * model();
-
-    QDataflowModelNode * node() const;
-    int index() const;
-    QString name() const;
-    QString type() const;
-
-    void addConnection(QDataflowModelConnection *conn);
-    void removeConnection(QDataflowModelConnection *conn);
-    QList<QDataflowModelConnection*> connections() const;
-
-signals:
-
-public slots:
-
-private:
-    QList<QDataflowModelConnection*> connections_;
-    QDataflowModelNode *node_;
-    int index_;
-    QString name_;
-    QString type_;
-};
-
-class QDataflowModelInlet : public QDataflowModelIOlet
-{
-    Q_OBJECT
-protected:
-    explicit QDataflowModelInlet(QDataflowModelNode *parent, int index, QString name = "", QString type = "*");
-
-public:
-    bool canAcceptConnectionFrom(QDataflowModelOutlet *outlet);
-
-signals:
-
-public slots:
-
-private:
-
-    friend class QDataflowModelNode;
-};
-
-QDebug operator<<(QDebug debug, const QDataflowModelInlet &inlet);
-QDebug operator<<(QDebug debug, const QDataflowModelInlet *inlet);
-
-class QDataflowModelOutlet : public QDataflowModelIOlet
-{
-    Q_OBJECT
-protected:
-    explicit QDataflowModelOutlet(QDataflowModelNode *parent, int index, QString name = "", QString type = "*");
-
-public:
-    bool canMakeConnectionTo(QDataflowModelInlet *inlet);
-
-signals:
-
-public slots:
-
-private:
-
-    friend class QDataflowModelNode;
-};
-
-QDebug operator<<(QDebug debug, const QDataflowModelOutlet &outlet);
-QDebug operator<<(QDebug debug, const QDataflowModelOutlet *outlet);
-
 class QDataflowModelConnection : public QObject
 {
     Q_OBJECT
 protected:
-    explicit QDataflowModelConnection(QDataflowModel *parent, QDataflowModelOutlet *source, QDataflowModelInlet *dest);
+    explicit QDataflowModelConnection(QDataflowModel *parent, const QDataflowModelOutlet &source, const QDataflowModelInlet &dest);
 
 public:
+    static void * operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
     QDataflowModel * model();
+    int id() const;
+
+    QDataflowModelOutlet source() const;
+    QDataflowModelInlet dest() const;
 
-    QDataflowModelOutlet * source() const;
-    QDataflowModelInlet * dest() const;
+    // how messages travel on this connection when the model is run by a
+    // QDataflowPipeline: Direct calls the destination on the sending
+    // thread, Queued goes through a lock-free queue to the thread of the
+    // destination's group, and Auto is Queued only between different
+    // thread groups
+    enum Transport {Auto, Direct, Queued};
+    Transport transport() const;
+    void setTransport(Transport transport);
+    bool isQueued() const;
 
 signals:
 
 public slots:
 
 private:
-    QDataflowModelOutlet *source_;
-    QDataflowModelInlet *dest_;
+    int id_;
+    QDataflowModelOutlet source_;
+    QDataflowModelInlet dest_;
+    Transport transport_;
 
     friend class QDataflowModel;
 };
@@ -254,16 +525,29 @@ public:
 
     QDataflowModelNode * node() {return node_;}
     void setNode(QDataflowModelNode *node) {node_ = node;}
-    QDataflowModelInlet * inlet(int index) {return node_->inlet(index);}
-    QDataflowModelOutlet * outlet(int index) {return node_->outlet(index);}
+    QDataflowModelInlet inlet(int index) {return node_->inlet(index);}
+    QDataflowModelOutlet outlet(int index) {return node_->outlet(index);}
     int inletCount() {return node_->inletCount();}
     void setInletCount(int c) {node_->setInletCount(c);}
     void setInletTypes(std::initializer_list<const char*> types) {node_->setInletTypes(types);}
     int outletCount() {return node_->outletCount();}
     void setOutletCount(int c) {node_->setOutletCount(c);}
     void setOutletTypes(std::initializer_list<const char*> types) {node_->setOutletTypes(types);}
-    virtual void onDataReceved(int inlet, void *data);
-    void sendData(int outlet, void *data);
+    virtual void onDataReceved(int inlet, const QDataflowMessage &message);
+    // blocks of samples (QDataflowMessage::Samples) are delivered here,
+    // see QDataflowKernels; by default each sample is passed on to
+    // onDataReceved() as a double
+    virtual void processBlock(int inlet, const float *samples, int n);
+    // meta objects which only forward messages (e.g. subpatch ports) get
+    // blocks as they are, in onDataReceved()
+    virtual bool forwardsBlocks() const {return false;}
+    // onDataReceved() or processBlock(), depending on the message
+    void receive(int inlet, const QDataflowMessage &message);
+    // the message is delivered by QDataflowScheduler: when called from
+    // onDataReceved(), after it returns; or by the executor of the model
+    // (see QDataflowExecutor), on one of its threads
+    void sendData(int outlet, const QDataflowMessage &message);
+    void sendBlock(int outlet, const float *samples, int n);
 
 private:
     QDataflowModelNode *node_;
@@ -287,8 +571,14 @@ private slots:
     void onNodeTextChanged(QDataflowModelNode *node, QString text);
     void onNodeInletCountChanged(QDataflowModelNode *node, int count);
     void onNodeOutletCountChanged(QDataflowModelNode *node, int count);
+    void onNodeInletTypeChanged(QDataflowModelNode *node, int index, QString type);
+    void onNodeOutletTypeChanged(QDataflowModelNode *node, int index, QString type);
     void onConnectionAdded(QDataflowModelConnection *conn);
     void onConnectionRemoved(QDataflowModelConnection *conn);
+    void onNodesAdded(QList<QDataflowModelNode*> nodes);
+    void onNodesRemoved(QList<QDataflowModelNode*> nodes);
+    void onConnectionsAdded(QList<QDataflowModelConnection*> conns);
+    void onConnectionsRemoved(QList<QDataflowModelConnection*> conns);
 };
 
 #endif // QDATAFLOWMODEL_H
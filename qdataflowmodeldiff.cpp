@@ -0,0 +1,391 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowmodeldiff.h"
+#include "qdataflowmodel.h"
+#include "qdataflowtyperegistry.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+
+namespace {
+
+// hash key of a node, by content (text and port types) and optionally
+// position; it refers to the node, so that building it copies nothing
+struct NodeKey
+{
+    QDataflowModelNode *node;
+    bool withPos;
+};
+
+bool samePorts(const QDataflowModelNode *a, const QDataflowModelNode *b, bool inlets)
+{
+    if(inlets)
+    {
+        if(a->inletCount() != b->inletCount()) return false;
+        for(int i = 0; i < a->inletCount(); i++)
+            if(a->inlet(i).typeId() != b->inlet(i).typeId()) return false;
+    }
+    else
+    {
+        if(a->outletCount() != b->outletCount()) return false;
+        for(int i = 0; i < a->outletCount(); i++)
+            if(a->outlet(i).typeId() != b->outlet(i).typeId()) return false;
+    }
+    return true;
+}
+
+bool operator==(const NodeKey &a, const NodeKey &b)
+{
+    if(a.withPos && a.node->pos() != b.node->pos()) return false;
+    return a.node->text() == b.node->text() && samePorts(a.node, b.node, true) && samePorts(a.node, b.node, false);
+}
+
+uint qHash(const NodeKey &key, uint seed = 0)
+{
+    const QDataflowModelNode *node = key.node;
+    uint h = qHash(node->text(), seed);
+    h = h * 31 + node->inletCount();
+    for(int i = 0; i < node->inletCount(); i++)
+        h = h * 31 + node->inlet(i).typeId();
+    h = h * 31 + node->outletCount();
+    for(int i = 0; i < node->outletCount(); i++)
+        h = h * 31 + node->outlet(i).typeId();
+    if(key.withPos)
+    {
+        h = h * 31 + node->pos().x();
+        h = h * 31 + node->pos().y();
+    }
+    return h;
+}
+
+struct ConnectionKey
+{
+    int sourceNode;
+    int sourceOutlet;
+    int destNode;
+    int destInlet;
+};
+
+bool operator==(const ConnectionKey &a, const ConnectionKey &b)
+{
+    return a.sourceNode == b.sourceNode && a.sourceOutlet == b.sourceOutlet && a.destNode == b.destNode && a.destInlet == b.destInlet;
+}
+
+uint qHash(const ConnectionKey &key, uint seed = 0)
+{
+    uint h = seed;
+    h = h * 31 + key.sourceNode;
+    h = h * 31 + key.sourceOutlet;
+    h = h * 31 + key.destNode;
+    h = h * 31 + key.destInlet;
+    return h;
+}
+
+// match the nodes not matched yet, by content (and position); candidates
+// with the same key are taken in ID order
+void matchByContent(const QDataflowModel *oldModel, const QDataflowModel *newModel, bool withPos, QVector<int> &oldIds, QVector<int> &newIds)
+{
+    QHash<NodeKey, int> first;
+    QVector<int> next(oldModel->nodeIdBound(), -1);
+    first.reserve(oldModel->nodeCount());
+
+    // chain the nodes with equal keys, walking backwards so that each chain
+    // is sorted by ID
+    for(int id = oldModel->nodeIdBound() - 1; id >= 0; id--)
+    {
+        QDataflowModelNode *node = oldModel->node(id);
+        if(!node || newIds[id] >= 0) continue;
+        NodeKey key = {node, withPos};
+        QHash<NodeKey, int>::iterator it = first.find(key);
+        if(it == first.end())
+        {
+            first.insert(key, id);
+        }
+        else
+        {
+            next[id] = it.value();
+            it.value() = id;
+        }
+    }
+
+    foreach(QDataflowModelNode *node, newModel->nodeRange())
+    {
+        if(oldIds[node->id()] >= 0) continue;
+        NodeKey key = {node, withPos};
+        QHash<NodeKey, int>::iterator it = first.find(key);
+        if(it == first.end() || it.value() < 0) continue;
+        int id = it.value();
+        it.value() = next[id];
+        oldIds[node->id()] = id;
+        newIds[id] = node->id();
+    }
+}
+
+QDataflowModelDiff::Node nodeState(const QDataflowModelNode *node)
+{
+    QDataflowModelDiff::Node ret;
+    ret.id = node->id();
+    ret.pos = node->pos();
+    ret.text = node->text();
+    ret.inletTypes = node->inletTypeIds();
+    ret.outletTypes = node->outletTypeIds();
+    return ret;
+}
+
+QStringList typeNames(const QVector<int> &types)
+{
+    QDataflowTypeRegistry *registry = QDataflowTypeRegistry::instance();
+    QStringList ret;
+    ret.reserve(types.size());
+    foreach(int type, types)
+        ret << registry->name(type);
+    return ret;
+}
+
+} // namespace
+
+QDataflowModelDiff::QDataflowModelDiff()
+{
+}
+
+QDataflowModelDiff QDataflowModelDiff::compute(const QDataflowModel *oldModel, const QDataflowModel *newModel, MatchMode mode)
+{
+    QDataflowModelDiff diff;
+    if(!oldModel || !newModel) return diff;
+
+    // node matching: oldIds_[newId] and newIds[oldId], or -1
+    diff.oldIds_.fill(-1, newModel->nodeIdBound());
+    QVector<int> newIds(oldModel->nodeIdBound(), -1);
+
+    if(mode == MatchById)
+    {
+        foreach(QDataflowModelNode *node, newModel->nodeRange())
+        {
+            if(!oldModel->node(node->id())) continue;
+            diff.oldIds_[node->id()] = node->id();
+            newIds[node->id()] = node->id();
+        }
+    }
+    else
+    {
+        // unmoved nodes first, so that a moved node is not matched with
+        // an identical node which stayed in place
+        matchByContent(oldModel, newModel, true, diff.oldIds_, newIds);
+        matchByContent(oldModel, newModel, false, diff.oldIds_, newIds);
+    }
+
+    foreach(QDataflowModelNode *node, oldModel->nodeRange())
+    {
+        if(newIds[node->id()] < 0)
+            diff.removedNodes_.push_back(node->id());
+    }
+
+    foreach(QDataflowModelNode *node, newModel->nodeRange())
+    {
+        int id = diff.oldIds_[node->id()];
+        if(id < 0)
+        {
+            diff.addedNodes_.push_back(nodeState(node));
+            continue;
+        }
+
+        QDataflowModelNode *oldNode = oldModel->node(id);
+        int changes = 0;
+        if(oldNode->pos() != node->pos()) changes |= PosChanged;
+        if(oldNode->text() != node->text()) changes |= TextChanged;
+        if(!samePorts(oldNode, node, true)) changes |= InletsChanged;
+        if(!samePorts(oldNode, node, false)) changes |= OutletsChanged;
+        if(!changes) continue;
+        ModifiedNode modified = {id, changes, nodeState(node)};
+        diff.modifiedNodes_.push_back(modified);
+    }
+
+    // connections of the old model, by node IDs of the old model; the
+    // ones found in the new model are taken out
+    QHash<ConnectionKey, int> oldConnections;
+    oldConnections.reserve(oldModel->connectionCount());
+    foreach(QDataflowModelConnection *conn, oldModel->connectionRange())
+    {
+        ConnectionKey key = {conn->source().node()->id(), conn->source().index(), conn->dest().node()->id(), conn->dest().index()};
+        oldConnections.insert(key, conn->id());
+    }
+
+    QBitArray kept(oldModel->connectionIdBound());
+    foreach(QDataflowModelConnection *conn, newModel->connectionRange())
+    {
+        Connection c = {conn->source().node()->id(), conn->source().index(), conn->dest().node()->id(), conn->dest().index()};
+        ConnectionKey key = {diff.oldIds_[c.sourceNode], c.sourceOutlet, diff.oldIds_[c.destNode], c.destInlet};
+        if(key.sourceNode >= 0 && key.destNode >= 0)
+        {
+            QHash<ConnectionKey, int>::iterator it = oldConnections.find(key);
+            if(it != oldConnections.end())
+            {
+                kept.setBit(it.value());
+                oldConnections.erase(it);
+                continue;
+            }
+        }
+        diff.addedConnections_.push_back(c);
+    }
+
+    foreach(QDataflowModelConnection *conn, oldModel->connectionRange())
+    {
+        if(kept.testBit(conn->id())) continue;
+        Connection c = {conn->source().node()->id(), conn->source().index(), conn->dest().node()->id(), conn->dest().index()};
+        diff.removedConnections_.push_back(c);
+    }
+
+    return diff;
+}
+
+bool QDataflowModelDiff::isEmpty() const
+{
+    return removedNodes_.isEmpty() && addedNodes_.isEmpty() && modifiedNodes_.isEmpty() &&
+            removedConnections_.isEmpty() && addedConnections_.isEmpty();
+}
+
+bool QDataflowModelDiff::apply(QDataflowModel *model) const
+{
+    if(!model) return false;
+
+    foreach(int id, removedNodes_)
+        if(!model->node(id)) return false;
+    foreach(const ModifiedNode &modified, modifiedNodes_)
+        if(!model->node(modified.id)) return false;
+
+    // check that the added connections can be made, against the ports the
+    // nodes will have, so that failing doesn't leave the changes half done
+    QSet<int> removed;
+    foreach(int id, removedNodes_)
+        removed.insert(id);
+    QHash<int, const ModifiedNode*> modified;
+    foreach(const ModifiedNode &m, modifiedNodes_)
+        modified.insert(m.id, &m);
+    QHash<int, const Node*> added;
+    foreach(const Node &n, addedNodes_)
+        added.insert(n.id, &n);
+    typedef QPair<QPair<int, int>, QPair<int, int> > Key;
+    QSet<Key> disconnected;
+    foreach(const Connection &c, removedConnections_)
+        disconnected.insert(qMakePair(qMakePair(c.sourceNode, c.sourceOutlet), qMakePair(c.destNode, c.destInlet)));
+
+    // the port types a node of the new model will have (false if the node
+    // won't be there)
+    auto portTypes = [&](int newId, bool inlets, QVector<int> *types) -> bool
+    {
+        int id = oldId(newId);
+        if(id < 0)
+        {
+            const Node *n = added.value(newId);
+            if(!n) return false;
+            *types = inlets ? n->inletTypes : n->outletTypes;
+            return true;
+        }
+        QDataflowModelNode *node = model->node(id);
+        if(!node || removed.contains(id)) return false;
+        const ModifiedNode *m = modified.value(id);
+        if(m && (m->changes & (TextChanged | (inlets ? InletsChanged : OutletsChanged))))
+            *types = inlets ? m->state.inletTypes : m->state.outletTypes;
+        else
+            *types = inlets ? node->inletTypeIds() : node->outletTypeIds();
+        return true;
+    };
+
+    QDataflowTypeRegistry *registry = QDataflowTypeRegistry::instance();
+    foreach(const Connection &c, addedConnections_)
+    {
+        QVector<int> outletTypes, inletTypes;
+        if(!portTypes(c.sourceNode, false, &outletTypes) || !portTypes(c.destNode, true, &inletTypes))
+            return false;
+        if(c.sourceOutlet < 0 || c.sourceOutlet >= outletTypes.size() ||
+                c.destInlet < 0 || c.destInlet >= inletTypes.size())
+            return false;
+        if(!registry->isCompatible(outletTypes.at(c.sourceOutlet), inletTypes.at(c.destInlet)))
+            return false;
+
+        // an existing connection stays, unless removed: its ports stay, and
+        // their types are compatible
+        int sourceId = oldId(c.sourceNode), destId = oldId(c.destNode);
+        if(sourceId >= 0 && destId >= 0 &&
+                !model->findConnections(model->node(sourceId), c.sourceOutlet, model->node(destId), c.destInlet).isEmpty() &&
+                !disconnected.contains(qMakePair(qMakePair(sourceId, c.sourceOutlet), qMakePair(destId, c.destInlet))))
+            return false;
+    }
+
+    QDataflowModelUpdateGuard guard(model);
+    bool ok = true;
+
+    // connections first, as they may refer to ports which are removed below
+    foreach(const Connection &c, removedConnections_)
+    {
+        model->disconnect(model->node(c.sourceNode), c.sourceOutlet, model->node(c.destNode), c.destInlet);
+    }
+
+    foreach(int id, removedNodes_)
+    {
+        model->remove(model->node(id));
+    }
+
+    foreach(const ModifiedNode &modified, modifiedNodes_)
+    {
+        QDataflowModelNode *node = model->node(modified.id);
+        if(modified.changes & PosChanged)
+            node->setPos(modified.state.pos);
+        if(modified.changes & TextChanged)
+            node->setText(modified.state.text);
+        // set the ports in any case, as receivers of nodeTextChanged may
+        // have changed them
+        if(modified.changes & (TextChanged | InletsChanged))
+            node->setInletTypes(typeNames(modified.state.inletTypes));
+        if(modified.changes & (TextChanged | OutletsChanged))
+            node->setOutletTypes(typeNames(modified.state.outletTypes));
+    }
+
+    QHash<int, QDataflowModelNode*> created;
+    created.reserve(addedNodes_.size());
+    model->reserve(addedNodes_.size(), addedConnections_.size());
+    foreach(const Node &n, addedNodes_)
+    {
+        QDataflowModelNode *node = model->create(n.pos, n.text, 0, 0);
+        node->setInletTypes(typeNames(n.inletTypes));
+        node->setOutletTypes(typeNames(n.outletTypes));
+        created.insert(n.id, node);
+    }
+
+    foreach(const Connection &c, addedConnections_)
+    {
+        int sourceId = oldId(c.sourceNode), destId = oldId(c.destNode);
+        QDataflowModelNode *source = sourceId >= 0 ? model->node(sourceId) : created.value(c.sourceNode);
+        QDataflowModelNode *dest = destId >= 0 ? model->node(destId) : created.value(c.destNode);
+        if(!source || !dest || !model->connect(source, c.sourceOutlet, dest, c.destInlet))
+            ok = false;
+    }
+
+    return ok;
+}
+
+QDebug operator<<(QDebug debug, const QDataflowModelDiff &diff)
+{
+    QDebugStateSaver stateSaver(debug);
+    debug.nospace() << "QDataflowModelDiff";
+    debug.nospace() << "(nodes: +" << diff.addedNodes().size() << " -" << diff.removedNodes().size() << " ~" << diff.modifiedNodes().size()
+                    << ", connections: +" << diff.addedConnections().size() << " -" << diff.removedConnections().size() << ")";
+    return debug;
+}
@@ -0,0 +1,117 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWMODELDIFF_H
+#define QDATAFLOWMODELDIFF_H
+
+#include <QDebug>
+#include <QPoint>
+#include <QString>
+#include <QVector>
+
+class QDataflowModel;
+
+// Structural difference between two models (e.g. a deployed and an edited
+// version of a patch), which can be applied as a patch to a model having
+// the same contents as the first one.
+//
+// Nodes of the two models are matched either by ID, or by content: a node
+// matches a node of the other model with the same text and port types,
+// preferring one at the same position (nodes are hashed, so the diff runs
+// in linear time). Matched nodes are reported as modified if their position,
+// text or ports differ; unmatched ones as removed or added. Connections are
+// compared through the node matching.
+class QDataflowModelDiff
+{
+public:
+    enum MatchMode
+    {
+        MatchById,
+        MatchByContent
+    };
+
+    enum Change
+    {
+        PosChanged = 0x1,
+        TextChanged = 0x2,
+        InletsChanged = 0x4,
+        OutletsChanged = 0x8
+    };
+
+    // port types are interned (see QDataflowTypeRegistry)
+    struct Node
+    {
+        int id;
+        QPoint pos;
+        QString text;
+        QVector<int> inletTypes;
+        QVector<int> outletTypes;
+    };
+
+    // id is the ID in the old model, and state the node in the new model
+    struct ModifiedNode
+    {
+        int id;
+        int changes;
+        Node state;
+    };
+
+    struct Connection
+    {
+        int sourceNode;
+        int sourceOutlet;
+        int destNode;
+        int destInlet;
+    };
+
+    QDataflowModelDiff();
+
+    static QDataflowModelDiff compute(const QDataflowModel *oldModel, const QDataflowModel *newModel, MatchMode mode = MatchById);
+
+    bool isEmpty() const;
+
+    // removed nodes and connections refer to node IDs of the old model,
+    // added nodes and connections to node IDs of the new model
+    const QVector<int> & removedNodes() const {return removedNodes_;}
+    const QVector<Node> & addedNodes() const {return addedNodes_;}
+    const QVector<ModifiedNode> & modifiedNodes() const {return modifiedNodes_;}
+    const QVector<Connection> & removedConnections() const {return removedConnections_;}
+    const QVector<Connection> & addedConnections() const {return addedConnections_;}
+
+    // ID in the old model of a node of the new model, or -1 if it was added
+    int oldId(int newId) const {return oldIds_.value(newId, -1);}
+
+    // apply the changes to a model with the contents of the old model, in
+    // one transaction; nothing is changed (and false is returned) if some
+    // node to remove or modify is missing from the model, or if some added
+    // connection can't be made (its nodes or ports would be missing, its
+    // port types are incompatible, or it would already exist). Receivers
+    // of the model signals changing the model meanwhile can still make a
+    // connection fail, and false is returned after the other changes.
+    bool apply(QDataflowModel *model) const;
+
+private:
+    QVector<int> removedNodes_;
+    QVector<Node> addedNodes_;
+    QVector<ModifiedNode> modifiedNodes_;
+    QVector<Connection> removedConnections_;
+    QVector<Connection> addedConnections_;
+    QVector<int> oldIds_;
+};
+
+QDebug operator<<(QDebug debug, const QDataflowModelDiff &diff);
+
+#endif // QDATAFLOWMODELDIFF_H
@@ -0,0 +1,178 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowmodelsnapshot.h"
+#include "qdataflowmodel.h"
+
+namespace {
+
+QVector<int> idsOf(const QVector<QDataflowModelConnection*> &conns)
+{
+    QVector<int> ret;
+    ret.reserve(conns.size());
+    foreach(QDataflowModelConnection *conn, conns)
+        ret.push_back(conn->id());
+    return ret;
+}
+
+bool isDirty(const QBitArray &dirtyChunks, int chunk)
+{
+    return chunk >= dirtyChunks.size() || dirtyChunks.testBit(chunk);
+}
+
+} // namespace
+
+QDataflowModelSnapshot::QDataflowModelSnapshot()
+{
+}
+
+QDataflowModelSnapshot::QDataflowModelSnapshot(const QDataflowModel *model, const QDataflowModelSnapshot &previous, const QBitArray &dirtyNodeChunks, const QBitArray &dirtyConnectionChunks)
+{
+    QSharedPointer<Data> d(new Data);
+    d->nodeCount = model->nodeCount();
+    d->connectionCount = model->connectionCount();
+    d->nodeIdBound = model->nodeIdBound();
+    d->connectionIdBound = model->connectionIdBound();
+
+    const Data *old = previous.d_.data();
+    int nodeChunkCount = (d->nodeIdBound + ChunkSize - 1) >> ChunkShift;
+    int connectionChunkCount = (d->connectionIdBound + ChunkSize - 1) >> ChunkShift;
+    d->nodeChunks.reserve(nodeChunkCount);
+    d->connectionChunks.reserve(connectionChunkCount);
+
+    for(int c = 0; c < nodeChunkCount; c++)
+    {
+        if(old && c < old->nodeChunks.size() && !isDirty(dirtyNodeChunks, c))
+        {
+            d->nodeChunks.push_back(old->nodeChunks.at(c));
+            continue;
+        }
+
+        NodeChunk *chunk = new NodeChunk;
+        int end = qMin(int(ChunkSize), d->nodeIdBound - (c << ChunkShift));
+        for(int i = 0; i < end; i++)
+        {
+            QDataflowModelNode *node = model->node((c << ChunkShift) + i);
+            if(!node) continue;
+            Node &n = chunk->nodes[i];
+            n.id = node->id();
+            n.pos = node->pos();
+            n.text = node->text();
+            n.valid = node->isValid();
+            n.inletTypes = node->inletTypeIds();
+            n.outletTypes = node->outletTypeIds();
+            for(int j = 0; j < node->inletCount(); j++)
+                n.inputs += idsOf(node->inlet(j).connections());
+            for(int j = 0; j < node->outletCount(); j++)
+                n.outputs += idsOf(node->outlet(j).connections());
+        }
+        d->nodeChunks.push_back(QSharedPointer<const NodeChunk>(chunk));
+    }
+
+    for(int c = 0; c < connectionChunkCount; c++)
+    {
+        if(old && c < old->connectionChunks.size() && !isDirty(dirtyConnectionChunks, c))
+        {
+            d->connectionChunks.push_back(old->connectionChunks.at(c));
+            continue;
+        }
+
+        ConnectionChunk *chunk = new ConnectionChunk;
+        int end = qMin(int(ChunkSize), d->connectionIdBound - (c << ChunkShift));
+        for(int i = 0; i < end; i++)
+        {
+            QDataflowModelConnection *conn = model->connection((c << ChunkShift) + i);
+            if(!conn) continue;
+            Connection &cn = chunk->connections[i];
+            cn.id = conn->id();
+            cn.sourceNode = conn->source().node()->id();
+            cn.sourceOutlet = conn->source().index();
+            cn.destNode = conn->dest().node()->id();
+            cn.destInlet = conn->dest().index();
+        }
+        d->connectionChunks.push_back(QSharedPointer<const ConnectionChunk>(chunk));
+    }
+
+    d_ = d;
+}
+
+bool QDataflowModelSnapshot::isNull() const
+{
+    return d_.isNull();
+}
+
+int QDataflowModelSnapshot::nodeCount() const
+{
+    return d_ ? d_->nodeCount : 0;
+}
+
+int QDataflowModelSnapshot::connectionCount() const
+{
+    return d_ ? d_->connectionCount : 0;
+}
+
+int QDataflowModelSnapshot::nodeIdBound() const
+{
+    return d_ ? d_->nodeIdBound : 0;
+}
+
+int QDataflowModelSnapshot::connectionIdBound() const
+{
+    return d_ ? d_->connectionIdBound : 0;
+}
+
+const QDataflowModelSnapshot::Node * QDataflowModelSnapshot::node(int id) const
+{
+    if(!d_ || id < 0 || id >= d_->nodeIdBound) return 0L;
+    const Node *n = &d_->nodeChunks.at(id >> ChunkShift)->nodes[id & (ChunkSize - 1)];
+    return n->id < 0 ? 0L : n;
+}
+
+const QDataflowModelSnapshot::Connection * QDataflowModelSnapshot::connection(int id) const
+{
+    if(!d_ || id < 0 || id >= d_->connectionIdBound) return 0L;
+    const Connection *c = &d_->connectionChunks.at(id >> ChunkShift)->connections[id & (ChunkSize - 1)];
+    return c->id < 0 ? 0L : c;
+}
+
+QVector<int> QDataflowModelSnapshot::nodeIds() const
+{
+    QVector<int> ret;
+    ret.reserve(nodeCount());
+    for(int id = 0; id < nodeIdBound(); id++)
+        if(node(id)) ret.push_back(id);
+    return ret;
+}
+
+QVector<int> QDataflowModelSnapshot::connectionIds() const
+{
+    QVector<int> ret;
+    ret.reserve(connectionCount());
+    for(int id = 0; id < connectionIdBound(); id++)
+        if(connection(id)) ret.push_back(id);
+    return ret;
+}
+
+int QDataflowModelSnapshot::sharedChunkCount(const QDataflowModelSnapshot &other) const
+{
+    if(!d_ || !other.d_) return 0;
+    int ret = 0;
+    for(int c = 0; c < qMin(d_->nodeChunks.size(), other.d_->nodeChunks.size()); c++)
+        if(d_->nodeChunks.at(c) == other.d_->nodeChunks.at(c)) ret++;
+    for(int c = 0; c < qMin(d_->connectionChunks.size(), other.d_->connectionChunks.size()); c++)
+        if(d_->connectionChunks.at(c) == other.d_->connectionChunks.at(c)) ret++;
+    return ret;
+}
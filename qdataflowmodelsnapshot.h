@@ -0,0 +1,117 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWMODELSNAPSHOT_H
+#define QDATAFLOWMODELSNAPSHOT_H
+
+#include <QBitArray>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+class QDataflowModel;
+
+// Immutable copy of the graph of a QDataflowModel (see
+// QDataflowModel::snapshot()), which can be read from any thread without
+// locking while the model keeps changing.
+//
+// Nodes and connections are stored by ID, in chunks of ChunkSize items;
+// a new snapshot shares with the previous one all the chunks in which
+// nothing changed, so taking a snapshot after a few edits is cheap, and
+// so is copying a snapshot around.
+class QDataflowModelSnapshot
+{
+public:
+    enum {ChunkShift = 8, ChunkSize = 1 << ChunkShift};
+
+    // port types are interned (see QDataflowTypeRegistry); inputs and
+    // outputs are the IDs of the connections to the inlets and from the
+    // outlets of the node
+    struct Node
+    {
+        Node() : id(-1), valid(false) {}
+
+        int id;
+        QPoint pos;
+        QString text;
+        bool valid;
+        QVector<int> inletTypes;
+        QVector<int> outletTypes;
+        QVector<int> inputs;
+        QVector<int> outputs;
+    };
+
+    struct Connection
+    {
+        Connection() : id(-1), sourceNode(-1), sourceOutlet(-1), destNode(-1), destInlet(-1) {}
+
+        int id;
+        int sourceNode;
+        int sourceOutlet;
+        int destNode;
+        int destInlet;
+    };
+
+    QDataflowModelSnapshot();
+
+    bool isNull() const;
+
+    int nodeCount() const;
+    int connectionCount() const;
+    int nodeIdBound() const;
+    int connectionIdBound() const;
+
+    // null if there is no such node/connection
+    const Node * node(int id) const;
+    const Connection * connection(int id) const;
+
+    QVector<int> nodeIds() const;
+    QVector<int> connectionIds() const;
+
+    // number of node and connection chunks shared with another snapshot
+    int sharedChunkCount(const QDataflowModelSnapshot &other) const;
+
+private:
+    struct NodeChunk
+    {
+        Node nodes[ChunkSize];
+    };
+
+    struct ConnectionChunk
+    {
+        Connection connections[ChunkSize];
+    };
+
+    struct Data
+    {
+        QVector<QSharedPointer<const NodeChunk> > nodeChunks;
+        QVector<QSharedPointer<const ConnectionChunk> > connectionChunks;
+        int nodeCount;
+        int connectionCount;
+        int nodeIdBound;
+        int connectionIdBound;
+    };
+
+    // a snapshot of model, rebuilding only the dirty chunks of previous
+    QDataflowModelSnapshot(const QDataflowModel *model, const QDataflowModelSnapshot &previous, const QBitArray &dirtyNodeChunks, const QBitArray &dirtyConnectionChunks);
+
+    QSharedPointer<const Data> d_;
+
+    friend class QDataflowModel;
+};
+
+#endif // QDATAFLOWMODELSNAPSHOT_H
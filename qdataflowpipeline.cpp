@@ -0,0 +1,233 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowpipeline.h"
+#include "qdataflowmodel.h"
+#include "qdataflowsubpatch.h"
+
+#include <QThread>
+
+class QDataflowPipelineThread : public QThread
+{
+public:
+    explicit QDataflowPipelineThread(QDataflowPipeline *pipeline)
+        : pipeline_(pipeline) {}
+
+    void run()
+    {
+        // no locks and no wait conditions: spin for a while, then back off
+        int idle = 0;
+        while(pipeline_->running_.loadAcquire())
+        {
+            if(pipeline_->drain(channels_))
+                idle = 0;
+            else if(++idle < 64)
+                QThread::yieldCurrentThread();
+            else
+                QThread::usleep(50);
+        }
+    }
+
+    QDataflowPipeline *pipeline_;
+    QList<QDataflowPipeline::Channel*> channels_;
+};
+
+QDataflowPipeline::QDataflowPipeline(QDataflowModel *model, int queueCapacity)
+    : QObject(model), model_(model), capacity_(queueCapacity)
+{
+    // the old pipeline stops (and detaches) first
+    delete model->pipeline_;
+    model->pipeline_ = this;
+
+    pollTimer_.setInterval(1);
+    QObject::connect(&pollTimer_, &QTimer::timeout, this, &QDataflowPipeline::pollModelThread);
+}
+
+QDataflowPipeline::~QDataflowPipeline()
+{
+    // the threads look the pipeline up through the model until joined
+    stop();
+
+    if(model_->pipeline_ == this)
+        model_->pipeline_ = 0L;
+
+    foreach(const QPointer<QDataflowSubpatch> &subpatch, subpatches_)
+        if(subpatch) subpatch->release();
+}
+
+QDataflowModel * QDataflowPipeline::model() const
+{
+    return model_;
+}
+
+int QDataflowPipeline::queueCapacity() const
+{
+    return capacity_;
+}
+
+void QDataflowPipeline::start()
+{
+    if(isRunning()) return;
+
+    // nested models can't be loaded, nor their plans compiled, by the
+    // pipeline threads
+    acquireSubpatches(model_);
+    foreach(const QPointer<QDataflowSubpatch> &subpatch, subpatches_)
+        if(subpatch && subpatch->isLoaded())
+            subpatch->model()->executionPlan();
+
+    plan_ = model_->executionPlan();
+
+    QHash<int, QDataflowPipelineThread*> groupThreads;
+    foreach(QDataflowModelConnection *conn, model_->connectionRange())
+    {
+        if(!conn->isQueued()) continue;
+        QDataflowModelNode *dest = conn->dest().node();
+        QDataflowMetaObject *mo = plan_.metaObject(dest->id());
+        if(!mo) continue;
+
+        Channel *channel = new Channel(capacity_);
+        channel->metaObject = mo;
+        channels_.insert(conn->id(), channel);
+
+        if(dest->threadGroup() == 0)
+        {
+            channel->consumer = model_->thread();
+            modelThreadChannels_.push_back(channel);
+            continue;
+        }
+
+        QDataflowPipelineThread *thread = groupThreads.value(dest->threadGroup());
+        if(!thread)
+        {
+            thread = new QDataflowPipelineThread(this);
+            groupThreads.insert(dest->threadGroup(), thread);
+            threads_.push_back(thread);
+        }
+        channel->consumer = thread;
+        thread->channels_.push_back(channel);
+    }
+
+    running_.storeRelease(1);
+    foreach(QDataflowPipelineThread *thread, threads_)
+        thread->start();
+    if(!modelThreadChannels_.isEmpty())
+        pollTimer_.start();
+}
+
+void QDataflowPipeline::stop()
+{
+    if(!isRunning()) return;
+
+    // until the threads are gone, messages must keep going through the
+    // queues: delivering them directly would run a node on the producer's
+    // thread, maybe while its own thread is running it, and ahead of the
+    // messages already queued. Let everything in flight be delivered
+    // (those for group 0 here), and only then let the threads go.
+    pollTimer_.stop();
+    while(inFlight_.loadAcquire() > 0)
+    {
+        if(!drain(modelThreadChannels_))
+            QThread::yieldCurrentThread();
+    }
+
+    running_.storeRelease(0);
+    foreach(QDataflowPipelineThread *thread, threads_)
+    {
+        thread->wait();
+        delete thread;
+    }
+    threads_.clear();
+
+    // from now on push() fails, and messages are delivered directly
+    qDeleteAll(channels_);
+    channels_.clear();
+    modelThreadChannels_.clear();
+}
+
+bool QDataflowPipeline::isRunning() const
+{
+    return running_.loadAcquire();
+}
+
+int QDataflowPipeline::threadCount() const
+{
+    return threads_.size();
+}
+
+int QDataflowPipeline::queueCount() const
+{
+    return channels_.size();
+}
+
+const QDataflowExecutionPlan & QDataflowPipeline::plan() const
+{
+    return plan_;
+}
+
+bool QDataflowPipeline::push(const QDataflowExecutionPlan::Target &target, const QDataflowMessage &message)
+{
+    if(!target.queued || !running_.loadAcquire()) return false;
+
+    // channels_ doesn't change while running
+    Channel *channel = channels_.value(target.connectionId);
+    if(!channel) return false;
+    // waiting for room in a queue only this thread can empty would never end
+    if(channel->consumer == QThread::currentThread()) return false;
+
+    // the consumer keeps running until everything in flight is delivered
+    // (see stop()), so there is always someone to make room
+    inFlight_.ref();
+    Delivery delivery = {target.inlet, message};
+    while(!channel->queue.tryPush(std::move(delivery)))
+        QThread::yieldCurrentThread();
+    return true;
+}
+
+void QDataflowPipeline::acquireSubpatches(QDataflowModel *model)
+{
+    foreach(QDataflowModelNode *node, model->nodeRange())
+    {
+        QDataflowSubpatch *subpatch = node->subpatch();
+        if(!subpatch || subpatches_.value(subpatch)) continue;
+        subpatch->acquire();
+        subpatches_.insert(subpatch, subpatch);
+        acquireSubpatches(subpatch->model());
+    }
+}
+
+void QDataflowPipeline::pollModelThread()
+{
+    drain(modelThreadChannels_);
+}
+
+bool QDataflowPipeline::drain(const QList<Channel*> &channels)
+{
+    bool delivered = false;
+    foreach(Channel *channel, channels)
+    {
+        // bounded, so that a busy channel doesn't starve the others
+        Delivery delivery;
+        for(int i = 0; i < 256 && channel->queue.tryPop(&delivery); i++)
+        {
+            channel->metaObject->receive(delivery.inlet, delivery.message);
+            // after receive(): what it pushed is already counted
+            inFlight_.deref();
+            delivered = true;
+        }
+    }
+    return delivered;
+}
@@ -0,0 +1,127 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWPIPELINE_H
+#define QDATAFLOWPIPELINE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+
+#include "qdataflowexecutionplan.h"
+#include "qdataflowmessage.h"
+#include "qdataflowspscqueue.h"
+
+class QDataflowModel;
+class QDataflowPipelineThread;
+class QDataflowSubpatch;
+class QThread;
+
+// Runs groups of nodes on dedicated threads, for streaming workloads:
+// every nonzero thread group (see QDataflowModelNode::setThreadGroup())
+// receiving queued messages gets its own thread, and the queued connections (see
+// QDataflowModelConnection::Transport; by default, those crossing
+// thread groups) become bounded lock-free single-producer/single-consumer
+// queues (QDataflowSpscQueue), so each stage of a pipeline runs on its own
+// core without taking any lock. Connections within a group are direct, as
+// usual (see QDataflowScheduler).
+//
+// Nodes of group 0 are not pinned: messages queued for them are delivered
+// on the model's thread, polled by a timer. A full queue makes the
+// producer wait (backpressure).
+//
+// Each queue must have a single producer: the thread running the source
+// node. This holds with the Auto transport, but not necessarily when
+// Direct connections cross thread groups. A cycle through queued
+// connections can deadlock once its queues are full.
+//
+// The queues and threads are set up by start(), from the topology and
+// thread groups at that time, and the meta objects they deliver to must
+// stay: any change to the execution plan of the model (or of the nested
+// models of its subpatches, which start() loads) stops the pipeline,
+// delivering what is still queued, and start() must be called again.
+// Such changes can't be made from the pipeline threads. The pipeline is
+// not used when the model has a QDataflowExecutor.
+class QDataflowPipeline : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QDataflowPipeline(QDataflowModel *model, int queueCapacity = 1024);
+    virtual ~QDataflowPipeline();
+
+    QDataflowModel * model() const;
+    int queueCapacity() const;
+
+    void start();
+    // from the model's thread: waits until the queued messages (and those
+    // they cause) have been delivered by their threads, then joins them
+    void stop();
+    bool isRunning() const;
+
+    int threadCount() const;
+    int queueCount() const;
+
+    // the plan the pipeline threads dispatch with (set by start())
+    const QDataflowExecutionPlan & plan() const;
+
+    // queue a message on a connection; false if the connection has no
+    // queue (or the pipeline isn't running), and the message must be
+    // delivered directly
+    bool push(const QDataflowExecutionPlan::Target &target, const QDataflowMessage &message);
+
+private slots:
+    void pollModelThread();
+
+private:
+    struct Delivery
+    {
+        int inlet;
+        QDataflowMessage message;
+    };
+
+    struct Channel
+    {
+        explicit Channel(int capacity) : queue(capacity), metaObject(0L), consumer(0L) {}
+
+        QDataflowSpscQueue<Delivery> queue;
+        QDataflowMetaObject *metaObject;
+        QThread *consumer;
+    };
+
+    void acquireSubpatches(QDataflowModel *model);
+    bool drain(const QList<Channel*> &channels);
+
+    QDataflowModel *model_;
+    int capacity_;
+    QDataflowExecutionPlan plan_;
+    // by connection ID; only changed while stopped
+    QHash<int, Channel*> channels_;
+    QList<Channel*> modelThreadChannels_;
+    QList<QDataflowPipelineThread*> threads_;
+    QTimer pollTimer_;
+    QAtomicInt running_;
+    // messages pushed and not yet delivered
+    QAtomicInt inFlight_;
+    QHash<QDataflowSubpatch*, QPointer<QDataflowSubpatch> > subpatches_;
+
+    friend class QDataflowPipelineThread;
+};
+
+#endif // QDATAFLOWPIPELINE_H
@@ -0,0 +1,133 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWPOOL_H
+#define QDATAFLOWPOOL_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+#include <cstddef>
+#include <new>
+
+// Free-list allocator for fixed-size objects (model nodes and connections).
+// Memory is reserved in slabs of SlabSize objects; freed objects go back to
+// the free list, and the slabs are returned to the heap by trim() once no
+// object of the pool is alive anymore.
+// Requests for a size other than sizeof(T) (i.e. subclasses of T) are
+// forwarded to the global operator new/delete.
+template<typename T>
+class QDataflowPool
+{
+public:
+    enum {SlabSize = 256};
+
+    static QDataflowPool<T> & instance()
+    {
+        static QDataflowPool<T> pool;
+        return pool;
+    }
+
+    void * allocate(size_t size)
+    {
+        if(size != sizeof(T))
+            return ::operator new(size);
+
+        QMutexLocker locker(&mutex_);
+        if(!freeList_)
+            addSlab();
+        FreeItem *item = freeList_;
+        freeList_ = item->next;
+        live_++;
+        return item;
+    }
+
+    void deallocate(void *p, size_t size)
+    {
+        if(!p) return;
+
+        if(size != sizeof(T))
+        {
+            ::operator delete(p);
+            return;
+        }
+
+        QMutexLocker locker(&mutex_);
+        FreeItem *item = static_cast<FreeItem*>(p);
+        item->next = freeList_;
+        freeList_ = item;
+        live_--;
+    }
+
+    void trim()
+    {
+        QMutexLocker locker(&mutex_);
+        if(live_ > 0) return;
+        foreach(char *slab, slabs_)
+            ::operator delete(slab);
+        slabs_.clear();
+        freeList_ = 0L;
+    }
+
+    int liveCount() const
+    {
+        QMutexLocker locker(&mutex_);
+        return live_;
+    }
+
+    size_t reservedBytes() const
+    {
+        QMutexLocker locker(&mutex_);
+        return size_t(slabs_.size()) * SlabSize * itemSize();
+    }
+
+private:
+    struct FreeItem
+    {
+        FreeItem *next;
+    };
+
+    QDataflowPool() : freeList_(0L), live_(0) {}
+    ~QDataflowPool() {trim();}
+    Q_DISABLE_COPY(QDataflowPool)
+
+    static size_t itemSize()
+    {
+        const size_t a = alignof(std::max_align_t);
+        size_t s = sizeof(T) < sizeof(FreeItem) ? sizeof(FreeItem) : sizeof(T);
+        return (s + a - 1) / a * a;
+    }
+
+    void addSlab()
+    {
+        char *slab = static_cast<char*>(::operator new(SlabSize * itemSize()));
+        slabs_.push_back(slab);
+        for(int i = SlabSize - 1; i >= 0; i--)
+        {
+            FreeItem *item = reinterpret_cast<FreeItem*>(slab + i * itemSize());
+            item->next = freeList_;
+            freeList_ = item;
+        }
+    }
+
+    mutable QMutex mutex_;
+    QVector<char*> slabs_;
+    FreeItem *freeList_;
+    int live_;
+};
+
+#endif // QDATAFLOWPOOL_H
@@ -0,0 +1,616 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowreplication.h"
+#include "qdataflowbinaryformat.h"
+#include "qdataflowmodel.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+
+namespace {
+
+enum MessageType
+{
+    Snapshot,
+    NodesAdded,
+    NodesRemoved,
+    NodesMoved,
+    NodeTextChanged,
+    NodeValidChanged,
+    NodeInletsChanged,
+    NodeOutletsChanged,
+    ConnectionsAdded,
+    ConnectionsRemoved,
+    // sent by followers
+    SnapshotRequest
+};
+
+enum
+{
+    SizeFieldSize = 4,
+    FrameHeaderSize = 9, // sequence number and type, following the size
+    StreamVersion = QDataStream::Qt_5_6
+};
+
+// a payload being encoded
+struct Message
+{
+    Message() : out(&payload, QIODevice::WriteOnly) {out.setVersion(StreamVersion);}
+
+    QByteArray payload;
+    QDataStream out;
+};
+
+QByteArray frame(quint64 sequenceNumber, int type, const QByteArray &payload)
+{
+    QByteArray ret;
+    QDataStream out(&ret, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << quint32(FrameHeaderSize + payload.size()) << quint64(sequenceNumber) << quint8(type);
+    out.writeRawData(payload.constData(), payload.size());
+    return ret;
+}
+
+// read the next frame if it has been received completely; frames too short
+// to be valid are skipped, with type set to -1
+bool readFrame(QIODevice *device, quint64 &sequenceNumber, int &type, QByteArray &payload)
+{
+    if(device->bytesAvailable() < SizeFieldSize) return false;
+    QByteArray sizeField = device->peek(SizeFieldSize);
+    quint32 size = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(sizeField.constData()));
+    if(device->bytesAvailable() < SizeFieldSize + qint64(size)) return false;
+
+    QByteArray data = device->read(SizeFieldSize + size);
+    if(size < FrameHeaderSize)
+    {
+        type = -1;
+        return true;
+    }
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData()) + SizeFieldSize;
+    sequenceNumber = qFromBigEndian<quint64>(p);
+    type = p[8];
+    payload = data.mid(SizeFieldSize + FrameHeaderSize);
+    return true;
+}
+
+QStringList inletTypes(const QDataflowModelNode *node)
+{
+    QStringList ret;
+    for(int i = 0; i < node->inletCount(); i++)
+        ret << node->inlet(i).type();
+    return ret;
+}
+
+QStringList outletTypes(const QDataflowModelNode *node)
+{
+    QStringList ret;
+    for(int i = 0; i < node->outletCount(); i++)
+        ret << node->outlet(i).type();
+    return ret;
+}
+
+void writeConnection(QDataStream &out, const QDataflowModelConnection *conn)
+{
+    out << qint32(conn->source().node()->id()) << qint32(conn->source().index())
+        << qint32(conn->dest().node()->id()) << qint32(conn->dest().index());
+}
+
+} // namespace
+
+QDataflowModelPublisher::QDataflowModelPublisher(QDataflowModel *model, QObject *parent)
+    : QObject(parent), model_(model), server_(0L), sequenceNumber_(0)
+{
+    coalescingTimer_.setSingleShot(true);
+    coalescingTimer_.setInterval(40);
+    QObject::connect(&coalescingTimer_, &QTimer::timeout, this, &QDataflowModelPublisher::flush);
+
+    QObject::connect(model_, &QDataflowModel::nodeAdded, this, &QDataflowModelPublisher::onNodeAdded);
+    QObject::connect(model_, &QDataflowModel::nodeRemoved, this, &QDataflowModelPublisher::onNodeRemoved);
+    QObject::connect(model_, &QDataflowModel::nodesAdded, this, &QDataflowModelPublisher::onNodesAdded);
+    QObject::connect(model_, &QDataflowModel::nodesRemoved, this, &QDataflowModelPublisher::onNodesRemoved);
+    QObject::connect(model_, &QDataflowModel::nodeValidChanged, this, &QDataflowModelPublisher::onNodeValidChanged);
+    QObject::connect(model_, &QDataflowModel::nodePosChanged, this, &QDataflowModelPublisher::onNodePosChanged);
+    QObject::connect(model_, &QDataflowModel::nodeTextChanged, this, &QDataflowModelPublisher::onNodeTextChanged);
+    QObject::connect(model_, &QDataflowModel::nodeInletCountChanged, this, &QDataflowModelPublisher::onNodeInletsChanged);
+    QObject::connect(model_, &QDataflowModel::nodeInletTypeChanged, this, &QDataflowModelPublisher::onNodeInletsChanged);
+    QObject::connect(model_, &QDataflowModel::nodeOutletCountChanged, this, &QDataflowModelPublisher::onNodeOutletsChanged);
+    QObject::connect(model_, &QDataflowModel::nodeOutletTypeChanged, this, &QDataflowModelPublisher::onNodeOutletsChanged);
+    QObject::connect(model_, &QDataflowModel::connectionAdded, this, &QDataflowModelPublisher::onConnectionAdded);
+    QObject::connect(model_, &QDataflowModel::connectionRemoved, this, &QDataflowModelPublisher::onConnectionRemoved);
+    QObject::connect(model_, &QDataflowModel::connectionsAdded, this, &QDataflowModelPublisher::onConnectionsAdded);
+    QObject::connect(model_, &QDataflowModel::connectionsRemoved, this, &QDataflowModelPublisher::onConnectionsRemoved);
+}
+
+QDataflowModelPublisher::~QDataflowModelPublisher()
+{
+    close();
+}
+
+QDataflowModel * QDataflowModelPublisher::model() const
+{
+    return model_;
+}
+
+bool QDataflowModelPublisher::listen(const QString &serverName)
+{
+    close();
+    server_ = new QLocalServer(this);
+    QObject::connect(server_, &QLocalServer::newConnection, this, &QDataflowModelPublisher::onNewConnection);
+    // a server which crashed may have left its socket behind
+    QLocalServer::removeServer(serverName);
+    if(server_->listen(serverName)) return true;
+    qDebug() << "QDataflowModelPublisher: cannot listen on" << serverName << ":" << server_->errorString();
+    delete server_;
+    server_ = 0L;
+    return false;
+}
+
+void QDataflowModelPublisher::close()
+{
+    foreach(QLocalSocket *follower, followers_)
+    {
+        follower->disconnect(this);
+        follower->abort();
+        follower->deleteLater();
+    }
+    followers_.clear();
+    pendingMoves_.clear();
+    coalescingTimer_.stop();
+    delete server_;
+    server_ = 0L;
+}
+
+bool QDataflowModelPublisher::isListening() const
+{
+    return server_;
+}
+
+int QDataflowModelPublisher::followerCount() const
+{
+    return followers_.size();
+}
+
+quint64 QDataflowModelPublisher::sequenceNumber() const
+{
+    return sequenceNumber_;
+}
+
+int QDataflowModelPublisher::coalescingInterval() const
+{
+    return coalescingTimer_.interval();
+}
+
+void QDataflowModelPublisher::setCoalescingInterval(int msecs)
+{
+    coalescingTimer_.setInterval(msecs);
+}
+
+void QDataflowModelPublisher::flush()
+{
+    coalescingTimer_.stop();
+    if(pendingMoves_.isEmpty()) return;
+
+    Message m;
+    m.out << qint32(pendingMoves_.size());
+    for(QHash<int, QPoint>::const_iterator it = pendingMoves_.constBegin(); it != pendingMoves_.constEnd(); ++it)
+        m.out << qint32(it.key()) << it.value();
+    pendingMoves_.clear();
+    send(NodesMoved, m.payload);
+}
+
+void QDataflowModelPublisher::onNewConnection()
+{
+    while(QLocalSocket *follower = server_->nextPendingConnection())
+    {
+        followers_.push_back(follower);
+        QObject::connect(follower, &QLocalSocket::readyRead, this, &QDataflowModelPublisher::onFollowerReadyRead);
+        QObject::connect(follower, &QLocalSocket::disconnected, this, &QDataflowModelPublisher::onFollowerDisconnected);
+        sendSnapshot(follower);
+    }
+}
+
+void QDataflowModelPublisher::onFollowerReadyRead()
+{
+    QLocalSocket *follower = qobject_cast<QLocalSocket*>(sender());
+    if(!follower) return;
+
+    quint64 sequenceNumber;
+    int type;
+    QByteArray payload;
+    while(readFrame(follower, sequenceNumber, type, payload))
+    {
+        if(type == SnapshotRequest)
+            sendSnapshot(follower);
+    }
+}
+
+void QDataflowModelPublisher::onFollowerDisconnected()
+{
+    QLocalSocket *follower = qobject_cast<QLocalSocket*>(sender());
+    if(!follower) return;
+    followers_.removeAll(follower);
+    follower->deleteLater();
+    if(followers_.isEmpty())
+    {
+        pendingMoves_.clear();
+        coalescingTimer_.stop();
+    }
+}
+
+void QDataflowModelPublisher::onNodeAdded(QDataflowModelNode *node)
+{
+    onNodesAdded(QList<QDataflowModelNode*>() << node);
+}
+
+void QDataflowModelPublisher::onNodeRemoved(QDataflowModelNode *node)
+{
+    onNodesRemoved(QList<QDataflowModelNode*>() << node);
+}
+
+void QDataflowModelPublisher::onNodesAdded(QList<QDataflowModelNode*> nodes)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(nodes.size());
+    foreach(QDataflowModelNode *node, nodes)
+        m.out << qint32(node->id()) << node->pos() << node->text() << node->isValid() << inletTypes(node) << outletTypes(node);
+    send(NodesAdded, m.payload);
+}
+
+void QDataflowModelPublisher::onNodesRemoved(QList<QDataflowModelNode*> nodes)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(nodes.size());
+    foreach(QDataflowModelNode *node, nodes)
+    {
+        m.out << qint32(node->id());
+        pendingMoves_.remove(node->id());
+    }
+    send(NodesRemoved, m.payload);
+}
+
+void QDataflowModelPublisher::onNodeValidChanged(QDataflowModelNode *node, bool valid)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(node->id()) << valid;
+    send(NodeValidChanged, m.payload);
+}
+
+void QDataflowModelPublisher::onNodePosChanged(QDataflowModelNode *node, QPoint pos)
+{
+    if(followers_.isEmpty()) return;
+    pendingMoves_.insert(node->id(), pos);
+    if(!coalescingTimer_.isActive())
+        coalescingTimer_.start();
+}
+
+void QDataflowModelPublisher::onNodeTextChanged(QDataflowModelNode *node, QString text)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(node->id()) << text;
+    send(NodeTextChanged, m.payload);
+}
+
+void QDataflowModelPublisher::onNodeInletsChanged(QDataflowModelNode *node)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(node->id()) << inletTypes(node);
+    send(NodeInletsChanged, m.payload);
+}
+
+void QDataflowModelPublisher::onNodeOutletsChanged(QDataflowModelNode *node)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(node->id()) << outletTypes(node);
+    send(NodeOutletsChanged, m.payload);
+}
+
+void QDataflowModelPublisher::onConnectionAdded(QDataflowModelConnection *conn)
+{
+    onConnectionsAdded(QList<QDataflowModelConnection*>() << conn);
+}
+
+void QDataflowModelPublisher::onConnectionRemoved(QDataflowModelConnection *conn)
+{
+    onConnectionsRemoved(QList<QDataflowModelConnection*>() << conn);
+}
+
+void QDataflowModelPublisher::onConnectionsAdded(QList<QDataflowModelConnection*> conns)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(conns.size());
+    foreach(QDataflowModelConnection *conn, conns)
+        writeConnection(m.out, conn);
+    send(ConnectionsAdded, m.payload);
+}
+
+void QDataflowModelPublisher::onConnectionsRemoved(QList<QDataflowModelConnection*> conns)
+{
+    if(followers_.isEmpty()) return;
+    Message m;
+    m.out << qint32(conns.size());
+    foreach(QDataflowModelConnection *conn, conns)
+        writeConnection(m.out, conn);
+    send(ConnectionsRemoved, m.payload);
+}
+
+void QDataflowModelPublisher::send(int type, const QByteArray &payload)
+{
+    if(followers_.isEmpty()) return;
+
+    // coalesced moves happened before this change
+    if(type != NodesMoved) flush();
+
+    QByteArray data = frame(++sequenceNumber_, type, payload);
+    foreach(QLocalSocket *follower, followers_)
+        follower->write(data);
+}
+
+void QDataflowModelPublisher::sendSnapshot(QLocalSocket *follower)
+{
+    if(model_->isUpdating())
+    {
+        // the model has changes not reported yet: wait for them to be
+        // reported, so that they are not applied twice by the follower
+        QTimer::singleShot(0, this, [=]() {
+            if(followers_.contains(follower))
+                sendSnapshot(follower);
+        });
+        return;
+    }
+
+    // the snapshot includes the moves not sent yet; the other followers
+    // get them now
+    flush();
+
+    Message m;
+    QVector<qint32> ids;
+    ids.reserve(model_->nodeCount());
+    foreach(QDataflowModelNode *node, model_->nodeRange())
+        ids.push_back(node->id());
+    m.out << ids << QDataflowBinaryFormat::toByteArray(model_);
+    follower->write(frame(sequenceNumber_, Snapshot, m.payload));
+}
+
+QDataflowModelFollower::QDataflowModelFollower(QDataflowModel *model, QObject *parent)
+    : QObject(parent), model_(model), socket_(new QLocalSocket(this)), synchronized_(false),
+      snapshotRequested_(false), sequenceNumber_(0)
+{
+    QObject::connect(socket_, &QLocalSocket::readyRead, this, &QDataflowModelFollower::onReadyRead);
+    QObject::connect(socket_, &QLocalSocket::disconnected, this, &QDataflowModelFollower::onDisconnected);
+}
+
+QDataflowModelFollower::~QDataflowModelFollower()
+{
+}
+
+QDataflowModel * QDataflowModelFollower::model() const
+{
+    return model_;
+}
+
+void QDataflowModelFollower::connectToPublisher(const QString &serverName)
+{
+    disconnectFromPublisher();
+    // the publisher sends a snapshot to new followers
+    snapshotRequested_ = true;
+    socket_->connectToServer(serverName);
+}
+
+void QDataflowModelFollower::disconnectFromPublisher()
+{
+    socket_->abort();
+    onDisconnected();
+}
+
+bool QDataflowModelFollower::isSynchronized() const
+{
+    return synchronized_;
+}
+
+quint64 QDataflowModelFollower::sequenceNumber() const
+{
+    return sequenceNumber_;
+}
+
+QDataflowModelNode * QDataflowModelFollower::node(int publisherId) const
+{
+    return model_->node(nodeIds_.value(publisherId, -1));
+}
+
+void QDataflowModelFollower::onReadyRead()
+{
+    quint64 sequenceNumber;
+    int type;
+    QByteArray payload;
+    while(readFrame(socket_, sequenceNumber, type, payload))
+    {
+        if(type >= 0)
+            process(sequenceNumber, type, payload);
+    }
+}
+
+void QDataflowModelFollower::onDisconnected()
+{
+    snapshotRequested_ = false;
+    if(!synchronized_) return;
+    synchronized_ = false;
+    emit desynchronized();
+}
+
+void QDataflowModelFollower::process(quint64 sequenceNumber, int type, const QByteArray &payload)
+{
+    if(type == Snapshot)
+    {
+        loadSnapshot(payload);
+        sequenceNumber_ = sequenceNumber;
+        return;
+    }
+
+    // changes are meaningless until the next snapshot
+    if(!synchronized_) return;
+
+    if(sequenceNumber != sequenceNumber_ + 1)
+    {
+        qDebug() << "QDataflowModelFollower: expected message" << sequenceNumber_ + 1 << "but got" << sequenceNumber;
+        synchronized_ = false;
+        emit desynchronized();
+        requestSnapshot();
+        return;
+    }
+    sequenceNumber_ = sequenceNumber;
+
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+    QDataflowModelUpdateGuard guard(model_);
+    qint32 count = 0, id = 0;
+
+    switch(type)
+    {
+    case NodesAdded:
+        in >> count;
+        for(int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+        {
+            QPoint pos;
+            QString text;
+            bool valid;
+            QStringList inlets, outlets;
+            in >> id >> pos >> text >> valid >> inlets >> outlets;
+            QDataflowModelNode *node = model_->create(pos, text, 0, 0);
+            node->setInletTypes(inlets);
+            node->setOutletTypes(outlets);
+            node->setValid(valid);
+            nodeIds_.insert(id, node->id());
+        }
+        break;
+    case NodesRemoved:
+        in >> count;
+        for(int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+        {
+            in >> id;
+            model_->remove(node(id));
+            nodeIds_.remove(id);
+        }
+        break;
+    case NodesMoved:
+        in >> count;
+        for(int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+        {
+            QPoint pos;
+            in >> id >> pos;
+            if(QDataflowModelNode *n = node(id))
+                n->setPos(pos);
+        }
+        break;
+    case NodeTextChanged:
+    {
+        QString text;
+        in >> id >> text;
+        if(QDataflowModelNode *n = node(id))
+            n->setText(text);
+        break;
+    }
+    case NodeValidChanged:
+    {
+        bool valid;
+        in >> id >> valid;
+        if(QDataflowModelNode *n = node(id))
+            n->setValid(valid);
+        break;
+    }
+    case NodeInletsChanged:
+    case NodeOutletsChanged:
+    {
+        QStringList types;
+        in >> id >> types;
+        if(QDataflowModelNode *n = node(id))
+        {
+            if(type == NodeInletsChanged)
+                n->setInletTypes(types);
+            else
+                n->setOutletTypes(types);
+        }
+        break;
+    }
+    case ConnectionsAdded:
+    case ConnectionsRemoved:
+        in >> count;
+        for(int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+        {
+            qint32 sourceNode, sourceOutlet, destNode, destInlet;
+            in >> sourceNode >> sourceOutlet >> destNode >> destInlet;
+            if(type == ConnectionsAdded)
+                model_->connect(node(sourceNode), sourceOutlet, node(destNode), destInlet);
+            else
+                model_->disconnect(node(sourceNode), sourceOutlet, node(destNode), destInlet);
+        }
+        break;
+    default:
+        break;
+    }
+
+    if(in.status() != QDataStream::Ok)
+        qDebug() << "QDataflowModelFollower: malformed message" << sequenceNumber;
+}
+
+void QDataflowModelFollower::loadSnapshot(const QByteArray &payload)
+{
+    QVector<qint32> ids;
+    QByteArray data;
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+    in >> ids >> data;
+
+    model_->clear();
+    nodeIds_.clear();
+    snapshotRequested_ = false;
+
+    if(in.status() != QDataStream::Ok || !QDataflowBinaryFormat::load(model_, data) || model_->nodeCount() != ids.size())
+    {
+        qDebug() << "QDataflowModelFollower: invalid snapshot";
+        model_->clear();
+        synchronized_ = false;
+        return;
+    }
+
+    // nodes are stored and loaded in ID order
+    nodeIds_.reserve(ids.size());
+    int i = 0;
+    foreach(QDataflowModelNode *node, model_->nodeRange())
+        nodeIds_.insert(ids[i++], node->id());
+
+    synchronized_ = true;
+    emit synchronized();
+}
+
+void QDataflowModelFollower::requestSnapshot()
+{
+    if(snapshotRequested_) return;
+    snapshotRequested_ = true;
+    socket_->write(frame(0, SnapshotRequest, QByteArray()));
+}
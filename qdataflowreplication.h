@@ -0,0 +1,145 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWREPLICATION_H
+#define QDATAFLOWREPLICATION_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QString>
+#include <QTimer>
+
+class QDataflowModel;
+class QDataflowModelNode;
+class QDataflowModelConnection;
+class QLocalServer;
+class QLocalSocket;
+
+// Replication of a model to other processes, over a local socket.
+//
+// The publisher sends to each follower a snapshot of the model (in the
+// binary format, see QDataflowBinaryFormat), followed by a stream of the
+// changes reported by the model signals. Messages are framed as
+//
+//   u32 size, u64 sequence number, u8 type, payload (QDataStream encoded)
+//
+// and numbered consecutively (a snapshot carries the number of the last
+// change it includes). Nodes are referred to by their ID in the publisher's
+// model; connections by their endpoints. Position changes are coalesced,
+// and sent at most once per coalescing interval.
+//
+// A follower which sees a gap in the sequence numbers asks for a new
+// snapshot. Port types are sent by name: followers need to declare the
+// same supertypes as the publisher (see QDataflowTypeRegistry), or some
+// connections will be refused.
+class QDataflowModelPublisher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QDataflowModelPublisher(QDataflowModel *model, QObject *parent = 0);
+    virtual ~QDataflowModelPublisher();
+
+    QDataflowModel * model() const;
+
+    bool listen(const QString &serverName);
+    void close();
+    bool isListening() const;
+    int followerCount() const;
+    quint64 sequenceNumber() const;
+
+    // in milliseconds
+    int coalescingInterval() const;
+    void setCoalescingInterval(int msecs);
+
+public slots:
+    // send the coalesced position changes now
+    void flush();
+
+private slots:
+    void onNewConnection();
+    void onFollowerReadyRead();
+    void onFollowerDisconnected();
+    void onNodeAdded(QDataflowModelNode *node);
+    void onNodeRemoved(QDataflowModelNode *node);
+    void onNodesAdded(QList<QDataflowModelNode*> nodes);
+    void onNodesRemoved(QList<QDataflowModelNode*> nodes);
+    void onNodeValidChanged(QDataflowModelNode *node, bool valid);
+    void onNodePosChanged(QDataflowModelNode *node, QPoint pos);
+    void onNodeTextChanged(QDataflowModelNode *node, QString text);
+    void onNodeInletsChanged(QDataflowModelNode *node);
+    void onNodeOutletsChanged(QDataflowModelNode *node);
+    void onConnectionAdded(QDataflowModelConnection *conn);
+    void onConnectionRemoved(QDataflowModelConnection *conn);
+    void onConnectionsAdded(QList<QDataflowModelConnection*> conns);
+    void onConnectionsRemoved(QList<QDataflowModelConnection*> conns);
+
+private:
+    void send(int type, const QByteArray &payload);
+    void sendSnapshot(QLocalSocket *follower);
+
+    QDataflowModel *model_;
+    QLocalServer *server_;
+    QList<QLocalSocket*> followers_;
+    quint64 sequenceNumber_;
+    QHash<int, QPoint> pendingMoves_;
+    QTimer coalescingTimer_;
+};
+
+class QDataflowModelFollower : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QDataflowModelFollower(QDataflowModel *model, QObject *parent = 0);
+    virtual ~QDataflowModelFollower();
+
+    QDataflowModel * model() const;
+
+    // the contents of the model are replaced with the publisher's ones
+    void connectToPublisher(const QString &serverName);
+    void disconnectFromPublisher();
+
+    // true after a snapshot has been received, and until a message is missed
+    bool isSynchronized() const;
+    quint64 sequenceNumber() const;
+
+    // the local node mirroring a node of the publisher, or null
+    QDataflowModelNode * node(int publisherId) const;
+
+signals:
+    void synchronized();
+    void desynchronized();
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    void process(quint64 sequenceNumber, int type, const QByteArray &payload);
+    void loadSnapshot(const QByteArray &payload);
+    void requestSnapshot();
+
+    QDataflowModel *model_;
+    QLocalSocket *socket_;
+    bool synchronized_;
+    bool snapshotRequested_;
+    quint64 sequenceNumber_;
+    // publisher's node ID -> local node ID
+    QHash<int, int> nodeIds_;
+};
+
+#endif // QDATAFLOWREPLICATION_H
@@ -0,0 +1,131 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowscheduler.h"
+#include "qdataflowmodel.h"
+#include "qdataflowpipeline.h"
+
+#include <QThread>
+#include <QThreadStorage>
+
+#include <algorithm>
+
+namespace {
+
+QThreadStorage<QDataflowScheduler*> schedulers;
+
+// the model compiles its plan on demand, which can only be done from its
+// thread; the threads of a pipeline use the plan it has been started with
+const QDataflowExecutionPlan & planFor(const QDataflowModel *model)
+{
+    QDataflowPipeline *pipeline = model->pipeline();
+    if(pipeline && pipeline->isRunning() && QThread::currentThread() != model->thread())
+        return pipeline->plan();
+    return model->executionPlan();
+}
+
+} // namespace
+
+QDataflowScheduler::QDataflowScheduler()
+    : running_(false), batchDepth_(0), batchMark_(0)
+{
+}
+
+QDataflowScheduler * QDataflowScheduler::instance()
+{
+    if(!schedulers.hasLocalData())
+        schedulers.setLocalData(new QDataflowScheduler());
+    return schedulers.localData();
+}
+
+void QDataflowScheduler::send(const QDataflowModel *model, int nodeId, int outlet, const QDataflowMessage &message)
+{
+    const QDataflowExecutionPlan &plan = planFor(model);
+    int first, last;
+    if(!plan.targetRange(nodeId, outlet, &first, &last) || first == last)
+        return;
+
+    Frame frame = {model, plan.revision(), plan.targets(), first, last, message};
+    stack_.push_back(frame);
+
+    if(!running_ && batchDepth_ == 0)
+        run();
+}
+
+void QDataflowScheduler::beginBatch()
+{
+    // inside run() sends are deferred anyway
+    if(batchDepth_++ == 0)
+        batchMark_ = stack_.size();
+}
+
+void QDataflowScheduler::endBatch()
+{
+    if(batchDepth_ <= 0 || --batchDepth_ > 0) return;
+    if(running_) return;
+
+    reverseFrom(batchMark_);
+    run();
+}
+
+void QDataflowScheduler::run()
+{
+    running_ = true;
+
+    while(!stack_.isEmpty())
+    {
+        // stack_ may be reallocated by the receiver: take everything needed
+        // out of the frame before delivering
+        Frame &top = stack_.last();
+        const QDataflowModel *model = top.model;
+        const int revision = top.revision;
+        const QDataflowExecutionPlan::Target target = top.targets.at(top.next++);
+        QDataflowMessage message;
+        if(top.next == top.end)
+        {
+            message = std::move(top.message);
+            stack_.removeLast();
+        }
+        else message = top.message;
+
+        // the model has changed since the message was sent: the target may
+        // have a different meta object by now, or no meta object at all
+        QDataflowMetaObject *mo = target.metaObject;
+        if(model->topologyRevision() != revision)
+            mo = planFor(model).metaObject(target.nodeId);
+        if(!mo) continue;
+
+        if(target.queued)
+        {
+            QDataflowPipeline *pipeline = model->pipeline();
+            if(pipeline && pipeline->push(target, message)) continue;
+        }
+
+        const int mark = stack_.size();
+        mo->receive(target.inlet, message);
+        reverseFrom(mark);
+    }
+
+    running_ = false;
+}
+
+void QDataflowScheduler::reverseFrom(int index)
+{
+    // frames pushed since index were sent in order, but the last one is
+    // on top of the stack
+    if(stack_.size() - index > 1)
+        std::reverse(stack_.begin() + index, stack_.end());
+}
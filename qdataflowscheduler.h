@@ -0,0 +1,93 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWSCHEDULER_H
+#define QDATAFLOWSCHEDULER_H
+
+#include <QVector>
+
+#include "qdataflowexecutionplan.h"
+#include "qdataflowmessage.h"
+
+class QDataflowModel;
+
+// Delivers the messages sent with QDataflowMetaObject::sendData() without
+// recursing: messages sent from within onDataReceved() are pushed on an
+// explicit stack and delivered by the outermost send() once the receiver
+// returns, so the depth of the C++ stack doesn't grow with the length of
+// a chain of nodes.
+//
+// The order is the same as with direct calls (depth-first): each message
+// reaches all the targets of an outlet in connection order, and the
+// messages sent by a receiver are delivered, in the order they were sent
+// (so a node sending right-to-left is seen as such downstream), before
+// the next target of the outer message. The only difference is that
+// sendData() returns before the message has been delivered.
+//
+// There is one scheduler per thread (see instance()). Between
+// beginBatch() and endBatch() (or in the scope of a
+// QDataflowSchedulerBatch) top-level sends are queued, and delivered in
+// one pass at the end.
+class QDataflowScheduler
+{
+public:
+    static QDataflowScheduler * instance();
+
+    void send(const QDataflowModel *model, int nodeId, int outlet, const QDataflowMessage &message);
+
+    void beginBatch();
+    void endBatch();
+
+    bool isRunning() const {return running_;}
+    // messages (i.e. outlets) not yet delivered to all their targets
+    int pendingCount() const {return stack_.size();}
+
+private:
+    QDataflowScheduler();
+
+    struct Frame
+    {
+        const QDataflowModel *model;
+        int revision;
+        // shared with the execution plan it comes from
+        QVector<QDataflowExecutionPlan::Target> targets;
+        int next;
+        int end;
+        QDataflowMessage message;
+    };
+
+    void run();
+    void reverseFrom(int index);
+
+    QVector<Frame> stack_;
+    bool running_;
+    int batchDepth_;
+    int batchMark_;
+};
+
+class QDataflowSchedulerBatch
+{
+public:
+    QDataflowSchedulerBatch() : scheduler_(QDataflowScheduler::instance()) {scheduler_->beginBatch();}
+    ~QDataflowSchedulerBatch() {scheduler_->endBatch();}
+
+private:
+    Q_DISABLE_COPY(QDataflowSchedulerBatch)
+
+    QDataflowScheduler *scheduler_;
+};
+
+#endif // QDATAFLOWSCHEDULER_H
@@ -0,0 +1,111 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWSPSCQUEUE_H
+#define QDATAFLOWSPSCQUEUE_H
+
+#include <QAtomicInt>
+
+// Bounded lock-free ring buffer for exactly one producer thread and one
+// consumer thread (see QDataflowPipeline). The capacity is rounded up to
+// a power of two. tryPush() fails when the queue is full, and tryPop()
+// when it is empty; neither ever blocks.
+//
+// The producer owns tail_ and the consumer owns head_; each side caches
+// the last index it read from the other, and only reloads it (with
+// acquire semantics) when the cached value says the queue is full/empty.
+// Both indices run freely and wrap around; their difference is the size.
+template<typename T>
+class QDataflowSpscQueue
+{
+public:
+    explicit QDataflowSpscQueue(int capacity)
+        : head_(0), cachedTail_(0), tail_(0), cachedHead_(0)
+    {
+        int size = 2;
+        while(size < capacity) size <<= 1;
+        mask_ = size - 1;
+        buffer_ = new T[size];
+    }
+
+    ~QDataflowSpscQueue()
+    {
+        delete[] buffer_;
+    }
+
+    int capacity() const {return mask_ + 1;}
+
+    // producer side
+    bool tryPush(T &&value)
+    {
+        const uint tail = uint(tail_.load());
+        if(tail - cachedHead_ > uint(mask_))
+        {
+            cachedHead_ = uint(head_.loadAcquire());
+            if(tail - cachedHead_ > uint(mask_))
+                return false;
+        }
+        buffer_[tail & uint(mask_)] = std::move(value);
+        tail_.storeRelease(int(tail + 1));
+        return true;
+    }
+
+    bool tryPush(const T &value)
+    {
+        T copy(value);
+        return tryPush(std::move(copy));
+    }
+
+    // consumer side
+    bool tryPop(T *value)
+    {
+        const uint head = uint(head_.load());
+        if(head == cachedTail_)
+        {
+            cachedTail_ = uint(tail_.loadAcquire());
+            if(head == cachedTail_)
+                return false;
+        }
+        // moving out leaves nothing shared behind in the slot
+        *value = std::move(buffer_[head & uint(mask_)]);
+        head_.storeRelease(int(head + 1));
+        return true;
+    }
+
+    // approximate, unless called by the consumer or the producer while the
+    // other side is idle
+    int size() const {return int(uint(tail_.loadAcquire()) - uint(head_.loadAcquire()));}
+    bool isEmpty() const {return size() == 0;}
+
+private:
+    Q_DISABLE_COPY(QDataflowSpscQueue)
+
+    enum {CacheLine = 64};
+
+    T *buffer_;
+    int mask_;
+    char pad0_[CacheLine];
+    // consumer
+    QAtomicInt head_;
+    uint cachedTail_;
+    char pad1_[CacheLine];
+    // producer
+    QAtomicInt tail_;
+    uint cachedHead_;
+    char pad2_[CacheLine];
+};
+
+#endif // QDATAFLOWSPSCQUEUE_H
@@ -0,0 +1,290 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowsubpatch.h"
+#include "qdataflowtextformat.h"
+#include "qdataflowundojournal.h"
+
+#include <QBuffer>
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+
+QStringList tokens(const QDataflowModelNode *node)
+{
+    return node->text().split(QRegExp("(\\ |\\t)"), QString::SkipEmptyParts);
+}
+
+QString proxyType(const QDataflowModelNode *node)
+{
+    return tokens(node).value(1, "*");
+}
+
+bool byPosition(QDataflowModelNode *a, QDataflowModelNode *b)
+{
+    if(a->pos().x() != b->pos().x()) return a->pos().x() < b->pos().x();
+    return a->id() < b->id();
+}
+
+} // namespace
+
+QDataflowSubpatch::QDataflowSubpatch(QDataflowModelNode *node)
+    : QObject(node), node_(node), model_(0L), useCount_(0)
+{
+}
+
+QDataflowSubpatch::~QDataflowSubpatch()
+{
+    if(model_)
+    {
+        emit unloading();
+        delete model_;
+    }
+}
+
+QDataflowModelNode * QDataflowSubpatch::node() const
+{
+    return node_;
+}
+
+bool QDataflowSubpatch::isLoaded() const
+{
+    return model_;
+}
+
+QDataflowModel * QDataflowSubpatch::model()
+{
+    if(model_) return model_;
+
+    model_ = new QDataflowModel(this);
+    QObject::connect(model_, &QDataflowModel::nodeAdded, this, &QDataflowSubpatch::onNodeChanged);
+    QObject::connect(model_, &QDataflowModel::nodeRemoved, this, &QDataflowSubpatch::onNodeChanged);
+    QObject::connect(model_, &QDataflowModel::nodePosChanged, this, &QDataflowSubpatch::onNodeChanged);
+    QObject::connect(model_, &QDataflowModel::nodeTextChanged, this, &QDataflowSubpatch::onNodeChanged);
+    QObject::connect(model_, &QDataflowModel::nodesAdded, this, &QDataflowSubpatch::onNodesChanged);
+    QObject::connect(model_, &QDataflowModel::nodesRemoved, this, &QDataflowSubpatch::onNodesChanged);
+
+    if(QDataflowModel *parentModel = node_->model())
+        emit parentModel->subpatchLoaded(node_, model_);
+
+    QDataflowTextFormat::load(model_, contents_);
+    contents_.clear();
+
+    // loading is not an edit
+    if(QDataflowUndoJournal *journal = model_->undoJournal())
+        journal->clear();
+
+    updatePorts();
+    return model_;
+}
+
+bool QDataflowSubpatch::unload()
+{
+    if(!model_) return true;
+    if(useCount_ > 0) return false;
+
+    contents_ = contents();
+    emit unloading();
+
+    // the nested model may be in the middle of delivering data (e.g. when
+    // the last user is released by an outlet proxy), so it goes later
+    QDataflowModel *model = model_;
+    model_ = 0L;
+    inletProxies_.clear();
+    outletProxies_.clear();
+    QObject::disconnect(model, 0, this, 0);
+    model->deleteLater();
+    return true;
+}
+
+QByteArray QDataflowSubpatch::contents() const
+{
+    if(!model_) return contents_;
+
+    QByteArray ret;
+    QBuffer buffer(&ret);
+    buffer.open(QIODevice::WriteOnly);
+    QDataflowTextFormat::save(model_, &buffer);
+    return ret;
+}
+
+void QDataflowSubpatch::setContents(const QByteArray &contents)
+{
+    if(!model_)
+    {
+        contents_ = contents;
+        return;
+    }
+
+    {
+        QDataflowModelUpdateGuard guard(model_);
+        model_->clear();
+        QDataflowTextFormat::load(model_, contents);
+    }
+    if(QDataflowUndoJournal *journal = model_->undoJournal())
+        journal->clear();
+}
+
+void QDataflowSubpatch::acquire()
+{
+    model();
+    useCount_++;
+}
+
+void QDataflowSubpatch::release()
+{
+    if(useCount_ <= 0) return;
+    if(--useCount_ == 0)
+        unload();
+}
+
+int QDataflowSubpatch::useCount() const
+{
+    return useCount_;
+}
+
+QList<QDataflowModelNode*> QDataflowSubpatch::inletProxies() const
+{
+    return inletProxies_;
+}
+
+QList<QDataflowModelNode*> QDataflowSubpatch::outletProxies() const
+{
+    return outletProxies_;
+}
+
+QDataflowSubpatch * QDataflowSubpatch::forModel(const QDataflowModel *model)
+{
+    return model ? qobject_cast<QDataflowSubpatch*>(model->parent()) : 0L;
+}
+
+bool QDataflowSubpatch::isInletProxy(const QDataflowModelNode *node)
+{
+    return tokens(node).value(0) == "inlet";
+}
+
+bool QDataflowSubpatch::isOutletProxy(const QDataflowModelNode *node)
+{
+    return tokens(node).value(0) == "outlet";
+}
+
+bool QDataflowSubpatch::isProxy(QDataflowModelNode *node) const
+{
+    return isInletProxy(node) || isOutletProxy(node) || inletProxies_.contains(node) || outletProxies_.contains(node);
+}
+
+void QDataflowSubpatch::updatePorts()
+{
+    if(!model_) return;
+
+    inletProxies_.clear();
+    outletProxies_.clear();
+    foreach(QDataflowModelNode *node, model_->nodeRange())
+    {
+        if(isInletProxy(node)) inletProxies_.push_back(node);
+        else if(isOutletProxy(node)) outletProxies_.push_back(node);
+    }
+    std::sort(inletProxies_.begin(), inletProxies_.end(), byPosition);
+    std::sort(outletProxies_.begin(), outletProxies_.end(), byPosition);
+
+    QStringList inletTypes, outletTypes, oldInletTypes, oldOutletTypes;
+    foreach(QDataflowModelNode *proxy, inletProxies_)
+        inletTypes << proxyType(proxy);
+    foreach(QDataflowModelNode *proxy, outletProxies_)
+        outletTypes << proxyType(proxy);
+    foreach(const QDataflowModelInlet &inlet, node_->inlets())
+        oldInletTypes << inlet.type();
+    foreach(const QDataflowModelOutlet &outlet, node_->outlets())
+        oldOutletTypes << outlet.type();
+
+    if(inletTypes != oldInletTypes)
+        node_->setInletTypes(inletTypes);
+    if(outletTypes != oldOutletTypes)
+        node_->setOutletTypes(outletTypes);
+}
+
+void QDataflowSubpatch::onNodeChanged(QDataflowModelNode *node)
+{
+    if(isProxy(node))
+        updatePorts();
+}
+
+void QDataflowSubpatch::onNodesChanged(QList<QDataflowModelNode*> nodes)
+{
+    foreach(QDataflowModelNode *node, nodes)
+    {
+        if(isProxy(node))
+        {
+            updatePorts();
+            return;
+        }
+    }
+}
+
+QDataflowSubpatchMetaObject::QDataflowSubpatchMetaObject(QDataflowModelNode *node)
+    : QDataflowMetaObject(node), subpatch_(node->makeSubpatch()), active_(false)
+{
+}
+
+QDataflowSubpatchMetaObject::~QDataflowSubpatchMetaObject()
+{
+    if(active_)
+        subpatch_->release();
+}
+
+void QDataflowSubpatchMetaObject::onDataReceved(int inlet, const QDataflowMessage &message)
+{
+    // other threads (i.e. a QDataflowExecutor) must have loaded it already
+    if(!active_ && QThread::currentThread() == subpatch_->thread())
+    {
+        subpatch_->acquire();
+        active_ = true;
+    }
+    if(!subpatch_->isLoaded()) return;
+
+    QDataflowModelNode *proxy = subpatch_->inletProxies().value(inlet);
+    if(proxy && proxy->dataflowMetaObject())
+        proxy->dataflowMetaObject()->sendData(0, message);
+}
+
+QDataflowInletProxyMetaObject::QDataflowInletProxyMetaObject(QDataflowModelNode *node, QStringList args)
+    : QDataflowMetaObject(node)
+{
+    node->setInletTypes(QStringList());
+    node->setOutletTypes(QStringList() << args.value(1, "*"));
+}
+
+QDataflowOutletProxyMetaObject::QDataflowOutletProxyMetaObject(QDataflowModelNode *node, QStringList args)
+    : QDataflowMetaObject(node)
+{
+    node->setInletTypes(QStringList() << args.value(1, "*"));
+    node->setOutletTypes(QStringList());
+}
+
+void QDataflowOutletProxyMetaObject::onDataReceved(int inlet, const QDataflowMessage &message)
+{
+    Q_UNUSED(inlet);
+
+    QDataflowSubpatch *subpatch = QDataflowSubpatch::forModel(node()->model());
+    if(!subpatch) return;
+    int index = subpatch->outletProxies().indexOf(node());
+    QDataflowMetaObject *mo = subpatch->node()->dataflowMetaObject();
+    if(index >= 0 && mo)
+        mo->sendData(index, message);
+}
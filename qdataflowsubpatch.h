@@ -0,0 +1,131 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWSUBPATCH_H
+#define QDATAFLOWSUBPATCH_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+
+#include "qdataflowmodel.h"
+
+// Contents of a subpatch node (see QDataflowModelNode::makeSubpatch()):
+// a nested QDataflowModel, which is kept serialized (in the text format,
+// see QDataflowTextFormat) until it is needed, i.e. until model() is
+// called, and is serialized again and released by unload().
+//
+// Nodes of the nested model with text "inlet [type]" and "outlet [type]"
+// are the proxies of the inlets and outlets of the subpatch node: while
+// the nested model is loaded, the ports of the subpatch node follow them
+// (ordered by x position). When the nested model is created, the model of
+// the subpatch node emits subpatchLoaded(), before filling it, so that
+// the application can set it up like the top level model.
+//
+// Users (e.g. a canvas showing the subpatch, or the meta object forwarding
+// data into it) keep the nested model loaded with acquire()/release(),
+// from the thread of the model; it is unloaded when the last user
+// releases it.
+class QDataflowSubpatch : public QObject
+{
+    Q_OBJECT
+public:
+    virtual ~QDataflowSubpatch();
+
+    QDataflowModelNode * node() const;
+
+    bool isLoaded() const;
+    QDataflowModel * model();
+    bool unload();
+
+    // serialized contents (serializing the nested model, if loaded)
+    QByteArray contents() const;
+    void setContents(const QByteArray &contents);
+
+    void acquire();
+    void release();
+    int useCount() const;
+
+    // proxies of the ports, in port order (empty if not loaded)
+    QList<QDataflowModelNode*> inletProxies() const;
+    QList<QDataflowModelNode*> outletProxies() const;
+
+    // the subpatch containing the given (nested) model, if any
+    static QDataflowSubpatch * forModel(const QDataflowModel *model);
+    static bool isInletProxy(const QDataflowModelNode *node);
+    static bool isOutletProxy(const QDataflowModelNode *node);
+
+signals:
+    // emitted before the nested model is deleted
+    void unloading();
+
+private slots:
+    void updatePorts();
+    void onNodeChanged(QDataflowModelNode *node);
+    void onNodesChanged(QList<QDataflowModelNode*> nodes);
+
+private:
+    explicit QDataflowSubpatch(QDataflowModelNode *node);
+
+    bool isProxy(QDataflowModelNode *node) const;
+
+    QDataflowModelNode *node_;
+    QByteArray contents_;
+    QDataflowModel *model_;
+    int useCount_;
+    QList<QDataflowModelNode*> inletProxies_;
+    QList<QDataflowModelNode*> outletProxies_;
+
+    friend class QDataflowModelNode;
+};
+
+// Meta object of a subpatch node: data received on an inlet is sent out
+// of the corresponding inlet proxy (loading the subpatch, which is kept
+// loaded while this meta object exists; only on the model's thread, on
+// other threads the subpatch must be loaded already)
+class QDataflowSubpatchMetaObject : public QDataflowMetaObject
+{
+public:
+    QDataflowSubpatchMetaObject(QDataflowModelNode *node);
+    ~QDataflowSubpatchMetaObject();
+
+    void onDataReceved(int inlet, const QDataflowMessage &message);
+    bool forwardsBlocks() const {return true;}
+
+private:
+    QDataflowSubpatch *subpatch_;
+    bool active_;
+};
+
+// Meta objects of the "inlet" and "outlet" proxy nodes; data received by
+// an outlet proxy is sent out of the corresponding outlet of the subpatch
+// node
+class QDataflowInletProxyMetaObject : public QDataflowMetaObject
+{
+public:
+    QDataflowInletProxyMetaObject(QDataflowModelNode *node, QStringList args);
+};
+
+class QDataflowOutletProxyMetaObject : public QDataflowMetaObject
+{
+public:
+    QDataflowOutletProxyMetaObject(QDataflowModelNode *node, QStringList args);
+
+    void onDataReceved(int inlet, const QDataflowMessage &message);
+    bool forwardsBlocks() const {return true;}
+};
+
+#endif // QDATAFLOWSUBPATCH_H
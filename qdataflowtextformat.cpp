@@ -0,0 +1,431 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowtextformat.h"
+#include "qdataflowmodel.h"
+#include "qdataflowsubpatch.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QVector>
+
+namespace {
+
+class Writer
+{
+public:
+    explicit Writer(QIODevice *device) : device_(device), ok_(true) {}
+
+    Writer & operator<<(const QByteArray &s)
+    {
+        buffer_ += s;
+        if(buffer_.size() >= QDataflowTextFormat::ChunkSize) flush();
+        return *this;
+    }
+
+    Writer & operator<<(const char *s) {return *this << QByteArray(s);}
+    Writer & operator<<(int v) {return *this << QByteArray::number(v);}
+
+    bool flush()
+    {
+        if(ok_ && !buffer_.isEmpty() && device_->write(buffer_) != buffer_.size())
+        {
+            qDebug() << "failed to write patch:" << device_->errorString();
+            ok_ = false;
+        }
+        buffer_.clear();
+        return ok_;
+    }
+
+private:
+    QIODevice *device_;
+    QByteArray buffer_;
+    bool ok_;
+};
+
+template<typename Range>
+bool writeNodes(const Range &nodes, int idBound, QIODevice *device)
+{
+    Writer out(device);
+    QVector<int> index(idBound, -1);
+    int count = 0;
+
+    out << "#N qdataflow " << QDataflowTextFormat::Version << ";\n";
+    foreach(QDataflowModelNode *node, nodes)
+    {
+        index[node->id()] = count++;
+        out << "#X obj " << node->pos().x() << " " << node->pos().y() << " " << QDataflowTextFormat::escape(node->text()) << ";\n";
+        if(node->inletCount() > 0)
+        {
+            out << "#X inlets";
+            for(int i = 0; i < node->inletCount(); i++)
+                out << " " << QDataflowTextFormat::escape(node->inlet(i).type(), true);
+            out << ";\n";
+        }
+        if(node->outletCount() > 0)
+        {
+            out << "#X outlets";
+            for(int i = 0; i < node->outletCount(); i++)
+                out << " " << QDataflowTextFormat::escape(node->outlet(i).type(), true);
+            out << ";\n";
+        }
+        if(QDataflowSubpatch *subpatch = node->subpatch())
+        {
+            QByteArray contents = subpatch->contents();
+            out << "#N subpatch;\n" << contents;
+            if(!contents.isEmpty() && !contents.endsWith('\n'))
+                out << "\n";
+            out << "#X restore;\n";
+        }
+    }
+
+    foreach(QDataflowModelNode *node, nodes)
+    {
+        for(int i = 0; i < node->outletCount(); i++)
+        {
+            foreach(QDataflowModelConnection *conn, node->outlet(i).connections())
+            {
+                int dest = index.value(conn->dest().node()->id(), -1);
+                if(dest < 0) continue;
+                out << "#X connect " << index.at(node->id()) << " " << i << " " << dest << " " << conn->dest().index() << ";\n";
+            }
+        }
+    }
+
+    return out.flush();
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// returns the next whitespace separated token (still escaped)
+QByteArray nextToken(const QByteArray &stmt, int &pos)
+{
+    const int n = stmt.size();
+    while(pos < n && isSpace(stmt.at(pos))) pos++;
+    int start = pos;
+    while(pos < n && !isSpace(stmt.at(pos)))
+        pos += stmt.at(pos) == '\\' ? 2 : 1;
+    pos = qMin(pos, n);
+    return stmt.mid(start, pos - start);
+}
+
+class Reader
+{
+public:
+    Reader(QDataflowModel *model, QPoint offset, QList<QDataflowModelNode*> *createdNodes, QDataflowTextFormat::Statistics *stats)
+        : model_(model), offset_(offset), createdNodes_(createdNodes), stats_(stats),
+          escaped_(false), lastNode_(0L), batch_(0), subpatchNode_(0L), subpatchDepth_(0)
+    {
+        model_->beginUpdate();
+    }
+
+    ~Reader()
+    {
+        model_->endUpdate();
+    }
+
+    void feed(const char *data, int size)
+    {
+        stats_->bytes += size;
+        int scanPos = buffer_.size();
+        buffer_.append(data, size);
+        const char *p = buffer_.constData();
+        int start = 0;
+        for(int i = scanPos; i < buffer_.size(); i++)
+        {
+            if(escaped_) escaped_ = false;
+            else if(p[i] == '\\') escaped_ = true;
+            else if(p[i] == ';')
+            {
+                statement(buffer_.mid(start, i - start));
+                start = i + 1;
+            }
+        }
+        buffer_.remove(0, start);
+    }
+
+    void finish()
+    {
+        if(!buffer_.trimmed().isEmpty())
+            statement(buffer_);
+        buffer_.clear();
+        if(subpatchDepth_ > 0)
+            error("#N subpatch (missing #X restore)");
+    }
+
+private:
+    void statement(const QByteArray &stmt)
+    {
+        int pos = 0;
+        QByteArray tag = nextToken(stmt, pos);
+        if(tag.isEmpty()) return;
+        stats_->statements++;
+        QByteArray kind = nextToken(stmt, pos);
+
+        if(subpatchDepth_ > 0)
+        {
+            subpatchStatement(stmt, tag, kind);
+            return;
+        }
+
+        if(tag == "#N")
+        {
+            if(kind == "subpatch")
+            {
+                // the contents are kept as they are, and parsed only if the
+                // subpatch is loaded
+                if(!lastNode_) error(stmt);
+                subpatchNode_ = lastNode_;
+                subpatchDepth_ = 1;
+            }
+            lastNode_ = 0L;
+            return;
+        }
+        if(tag != "#X")
+        {
+            error(stmt);
+            return;
+        }
+
+        if(kind == "obj")
+        {
+            bool okx, oky;
+            int x = nextToken(stmt, pos).toInt(&okx);
+            int y = nextToken(stmt, pos).toInt(&oky);
+            if(!okx || !oky) {error(stmt); return;}
+            nextBatch();
+            QString text = QDataflowTextFormat::unescape(stmt.mid(pos)).trimmed();
+            lastNode_ = model_->create(QPoint(x, y) + offset_, text, 0, 0);
+            nodes_.push_back(lastNode_);
+            if(createdNodes_) createdNodes_->push_back(lastNode_);
+            stats_->nodes++;
+        }
+        else if(kind == "inlets" || kind == "outlets")
+        {
+            if(!lastNode_) {error(stmt); return;}
+            QStringList types;
+            for(QByteArray tok = nextToken(stmt, pos); !tok.isEmpty(); tok = nextToken(stmt, pos))
+                types << QDataflowTextFormat::unescape(tok);
+            if(kind == "inlets")
+                lastNode_->setInletTypes(types);
+            else
+                lastNode_->setOutletTypes(types);
+        }
+        else if(kind == "connect")
+        {
+            lastNode_ = 0L;
+            int v[4];
+            for(int i = 0; i < 4; i++)
+            {
+                bool ok;
+                v[i] = nextToken(stmt, pos).toInt(&ok);
+                if(!ok || v[i] < 0) {error(stmt); return;}
+            }
+            if(v[0] >= nodes_.size() || v[2] >= nodes_.size()) {error(stmt); return;}
+            nextBatch();
+            if(model_->connect(nodes_.at(v[0]), v[1], nodes_.at(v[2]), v[3]))
+                stats_->connections++;
+            else
+                error(stmt);
+        }
+        else error(stmt);
+    }
+
+    void subpatchStatement(const QByteArray &stmt, const QByteArray &tag, const QByteArray &kind)
+    {
+        if(tag == "#N" && kind == "subpatch")
+            subpatchDepth_++;
+        else if(tag == "#X" && kind == "restore")
+            subpatchDepth_--;
+
+        if(subpatchDepth_ > 0)
+        {
+            (subpatchContents_ += stmt) += ';';
+            return;
+        }
+
+        if(subpatchNode_)
+            subpatchNode_->makeSubpatch()->setContents(subpatchContents_);
+        subpatchNode_ = 0L;
+        subpatchContents_.clear();
+    }
+
+    void nextBatch()
+    {
+        // only called before adding a node or a connection, so a node stays
+        // pending while its "#X inlets"/"#X outlets" statements are read
+        if(++batch_ <= QDataflowTextFormat::BatchSize) return;
+        model_->endUpdate();
+        model_->beginUpdate();
+        batch_ = 1;
+    }
+
+    void error(const QByteArray &stmt)
+    {
+        stats_->errors++;
+        qDebug() << "skipping malformed statement:" << stmt.trimmed().left(80);
+    }
+
+    QDataflowModel *model_;
+    QPoint offset_;
+    QList<QDataflowModelNode*> *createdNodes_;
+    QDataflowTextFormat::Statistics *stats_;
+    QByteArray buffer_;
+    bool escaped_;
+    QVector<QDataflowModelNode*> nodes_;
+    QDataflowModelNode *lastNode_;
+    int batch_;
+    // contents of the subpatch being read, and its nesting level
+    QDataflowModelNode *subpatchNode_;
+    QByteArray subpatchContents_;
+    int subpatchDepth_;
+};
+
+}
+
+double QDataflowTextFormat::Statistics::megabytesPerSecond() const
+{
+    if(nsecsElapsed <= 0) return 0;
+    return (bytes / 1e6) / (nsecsElapsed / 1e9);
+}
+
+bool QDataflowTextFormat::save(const QDataflowModel *model, QIODevice *device)
+{
+    return writeNodes(model->nodeRange(), model->nodeIdBound(), device);
+}
+
+bool QDataflowTextFormat::save(const QDataflowModel *model, const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "failed to open" << fileName << "for writing:" << file.errorString();
+        return false;
+    }
+    if(!save(model, &file))
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool QDataflowTextFormat::save(const QList<QDataflowModelNode*> &nodes, QIODevice *device)
+{
+    int idBound = 0;
+    foreach(QDataflowModelNode *node, nodes)
+        idBound = qMax(idBound, node->id() + 1);
+    return writeNodes(nodes, idBound, device);
+}
+
+QByteArray QDataflowTextFormat::toByteArray(const QList<QDataflowModelNode*> &nodes)
+{
+    QByteArray ret;
+    QBuffer buffer(&ret);
+    buffer.open(QIODevice::WriteOnly);
+    save(nodes, &buffer);
+    return ret;
+}
+
+bool QDataflowTextFormat::load(QDataflowModel *model, QIODevice *device, QPoint offset, QList<QDataflowModelNode*> *createdNodes, Statistics *stats)
+{
+    Statistics localStats;
+    if(!stats) stats = &localStats;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok = true;
+    {
+        Reader reader(model, offset, createdNodes, stats);
+        QByteArray chunk(ChunkSize, '\0');
+        for(;;)
+        {
+            qint64 n = device->read(chunk.data(), chunk.size());
+            if(n < 0)
+            {
+                qDebug() << "failed to read patch:" << device->errorString();
+                ok = false;
+                break;
+            }
+            if(n == 0) break;
+            reader.feed(chunk.constData(), n);
+        }
+        reader.finish();
+    }
+
+    stats->nsecsElapsed = timer.nsecsElapsed();
+    return ok;
+}
+
+bool QDataflowTextFormat::load(QDataflowModel *model, const QString &fileName, Statistics *stats)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "failed to open" << fileName << "for reading:" << file.errorString();
+        return false;
+    }
+    return load(model, &file, QPoint(), 0L, stats);
+}
+
+bool QDataflowTextFormat::load(QDataflowModel *model, const QByteArray &data, QPoint offset, QList<QDataflowModelNode*> *createdNodes, Statistics *stats)
+{
+    QByteArray copy(data);
+    QBuffer buffer(&copy);
+    buffer.open(QIODevice::ReadOnly);
+    return load(model, &buffer, offset, createdNodes, stats);
+}
+
+QByteArray QDataflowTextFormat::escape(const QString &text, bool escapeSpaces)
+{
+    QByteArray utf8 = text.toUtf8();
+    QByteArray ret;
+    ret.reserve(utf8.size());
+    foreach(char c, utf8)
+    {
+        if(c == '\n')
+            ret += "\\n";
+        else if(c == '\\' || c == ';' || (escapeSpaces && (c == ' ' || c == '\t')))
+            (ret += '\\') += c;
+        else
+            ret += c;
+    }
+    return ret;
+}
+
+QString QDataflowTextFormat::unescape(const QByteArray &text)
+{
+    QByteArray ret;
+    ret.reserve(text.size());
+    for(int i = 0; i < text.size(); i++)
+    {
+        char c = text.at(i);
+        if(c == '\\' && i + 1 < text.size())
+        {
+            c = text.at(++i);
+            if(c == 'n') c = '\n';
+        }
+        ret += c;
+    }
+    return QString::fromUtf8(ret);
+}
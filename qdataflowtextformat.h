@@ -0,0 +1,87 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWTEXTFORMAT_H
+#define QDATAFLOWTEXTFORMAT_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QList>
+#include <QPoint>
+#include <QString>
+
+class QDataflowModel;
+class QDataflowModelNode;
+
+// Text patch format, in the style of Pd patches: a sequence of statements
+// terminated by ';', one per line:
+//
+//   #N qdataflow 1;
+//   #X obj 100 50 add 5;
+//   #X inlets int *;
+//   #X outlets int;
+//   #X connect 0 0 1 0;
+//
+// "#X obj" creates a node at the given position, with the rest of the
+// statement as its text; the optional "#X inlets" and "#X outlets" that
+// follow it set the types of its inlets and outlets; "#X connect" refers
+// to nodes by their index in the sequence of "#X obj" statements.
+// A backslash escapes the next character ("\n" is a newline).
+//
+// The contents of a subpatch node (see QDataflowSubpatch) follow its
+// "#X obj" statement, as a nested patch between "#N subpatch;" and
+// "#X restore;"; they are not parsed when reading, but stored as they are
+// in the subpatch, until it is loaded.
+//
+// Patches are read and written in chunks, and never held entirely in
+// memory. Nodes and connections are added to the model in transactions
+// of (at most) BatchSize items.
+class QDataflowTextFormat
+{
+public:
+    enum {Version = 1, ChunkSize = 65536, BatchSize = 16384};
+
+    struct Statistics
+    {
+        Statistics() : bytes(0), statements(0), nodes(0), connections(0), errors(0), nsecsElapsed(0) {}
+
+        double megabytesPerSecond() const;
+
+        qint64 bytes;
+        int statements;
+        int nodes;
+        int connections;
+        int errors;
+        qint64 nsecsElapsed;
+    };
+
+    static bool save(const QDataflowModel *model, QIODevice *device);
+    static bool save(const QDataflowModel *model, const QString &fileName);
+    // write only the given nodes, and the connections between them
+    static bool save(const QList<QDataflowModelNode*> &nodes, QIODevice *device);
+    static QByteArray toByteArray(const QList<QDataflowModelNode*> &nodes);
+
+    // the contents are added to the model, moved by offset; malformed
+    // statements are skipped (and counted in stats->errors)
+    static bool load(QDataflowModel *model, QIODevice *device, QPoint offset = QPoint(), QList<QDataflowModelNode*> *createdNodes = 0L, Statistics *stats = 0L);
+    static bool load(QDataflowModel *model, const QString &fileName, Statistics *stats = 0L);
+    static bool load(QDataflowModel *model, const QByteArray &data, QPoint offset = QPoint(), QList<QDataflowModelNode*> *createdNodes = 0L, Statistics *stats = 0L);
+
+    static QByteArray escape(const QString &text, bool escapeSpaces = false);
+    static QString unescape(const QByteArray &text);
+};
+
+#endif // QDATAFLOWTEXTFORMAT_H
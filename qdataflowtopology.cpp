@@ -0,0 +1,537 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowtopology.h"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <limits>
+
+QDataflowTopology::QDataflowTopology()
+    : nodeCount_(0), valid_(true), condensed_(false), componentCount_(0), currentMark_(0)
+{
+}
+
+void QDataflowTopology::addNode(int id)
+{
+    if(id < 0 || contains(id)) return;
+    if(succ_.size() <= id)
+    {
+        succ_.resize(id + 1);
+        pred_.resize(id + 1);
+        alive_.resize(id + 1);
+        ord_.resize(id + 1);
+        mark_.resize(id + 1);
+    }
+    alive_[id] = true;
+    nodeCount_++;
+    if(condensed_)
+    {
+        // a new component, which can go last as well
+        if(component_.size() <= id)
+            component_.resize(id + 1);
+        component_[id] = componentCount_++;
+        condensationOrder_.push_back(id);
+    }
+    // a new node has no edges: putting it last keeps the order valid
+    ord_[id] = node_.size();
+    node_.push_back(id);
+}
+
+void QDataflowTopology::removeNode(int id)
+{
+    if(!contains(id)) return;
+    while(!succ_[id].isEmpty())
+        removeEdge(id, succ_[id].back());
+    while(!pred_[id].isEmpty())
+        removeEdge(pred_[id].back(), id);
+    invalidate(downstreamCache_, id);
+    invalidate(upstreamCache_, id);
+    succ_[id].clear();
+    pred_[id].clear();
+    alive_[id] = false;
+    nodeCount_--;
+    if(condensed_)
+        condensationOrder_.removeOne(id);
+    node_[ord_[id]] = -1;
+    ord_[id] = -1;
+    if(node_.size() > 64 && node_.size() > 2 * nodeCount_)
+        compact();
+}
+
+void QDataflowTopology::addEdge(int source, int dest)
+{
+    if(!contains(source) || !contains(dest)) return;
+    succ_[source].push_back(dest);
+    pred_[dest].push_back(source);
+    invalidate(downstreamCache_, source);
+    invalidate(upstreamCache_, dest);
+
+    if(!valid_)
+    {
+        // an edge within a component, or forward in the condensation, does
+        // not change it
+        if(condensed_ && component_[source] > component_[dest])
+            condensed_ = false;
+        return;
+    }
+    if(source == dest) {valid_ = false; condensed_ = false; return;}
+
+    const int lb = ord_[dest], ub = ord_[source];
+    if(lb > ub) return;
+
+    // forward search from dest, restricted to the affected region:
+    QVector<int> deltaF;
+    int mark = nextMark();
+    stack_.clear();
+    stack_.push_back(dest);
+    mark_[dest] = mark;
+    while(!stack_.isEmpty())
+    {
+        int n = stack_.back();
+        stack_.pop_back();
+        deltaF.push_back(n);
+        foreach(int w, succ_[n])
+        {
+            if(w == source) {valid_ = false; condensed_ = false; return;}
+            if(mark_[w] == mark || ord_[w] > ub) continue;
+            mark_[w] = mark;
+            stack_.push_back(w);
+        }
+    }
+
+    // backward search from source:
+    QVector<int> deltaB;
+    mark = nextMark();
+    stack_.push_back(source);
+    mark_[source] = mark;
+    while(!stack_.isEmpty())
+    {
+        int n = stack_.back();
+        stack_.pop_back();
+        deltaB.push_back(n);
+        foreach(int w, pred_[n])
+        {
+            if(mark_[w] == mark || ord_[w] < lb) continue;
+            mark_[w] = mark;
+            stack_.push_back(w);
+        }
+    }
+
+    // the nodes reaching source go before the nodes reachable from dest,
+    // reusing the same set of positions:
+    const QVector<int> &ord = ord_;
+    auto byOrder = [&ord](int a, int b) {return ord[a] < ord[b];};
+    std::sort(deltaB.begin(), deltaB.end(), byOrder);
+    std::sort(deltaF.begin(), deltaF.end(), byOrder);
+    QVector<int> affected = deltaB + deltaF;
+    QVector<int> positions;
+    positions.reserve(affected.size());
+    foreach(int n, affected)
+        positions.push_back(ord_[n]);
+    std::sort(positions.begin(), positions.end());
+    for(int i = 0; i < affected.size(); i++)
+    {
+        ord_[affected[i]] = positions[i];
+        node_[positions[i]] = affected[i];
+    }
+}
+
+void QDataflowTopology::addEdges(const QVector<QPair<int, int> > &edges)
+{
+    if(edges.isEmpty()) return;
+    typedef QPair<int, int> Edge;
+    foreach(const Edge &edge, edges)
+    {
+        if(!contains(edge.first) || !contains(edge.second)) continue;
+        succ_[edge.first].push_back(edge.second);
+        pred_[edge.second].push_back(edge.first);
+    }
+    downstreamCache_ = ClosureCache();
+    upstreamCache_ = ClosureCache();
+    // Kahn's algorithm over the whole graph (if there are cycles, the
+    // condensation is computed on demand)
+    valid_ = false;
+    condensed_ = false;
+    updateOrder();
+}
+
+void QDataflowTopology::removeEdge(int source, int dest)
+{
+    if(!contains(source) || !contains(dest)) return;
+    if(!succ_[source].removeOne(dest)) return;
+    pred_[dest].removeOne(source);
+    invalidate(downstreamCache_, source);
+    invalidate(upstreamCache_, dest);
+    // removing edges never invalidates an order, but may split a component
+    // of the condensation (and make the graph acyclic)
+    if(!valid_ && condensed_ && component_[source] == component_[dest])
+        condensed_ = false;
+}
+
+void QDataflowTopology::clear()
+{
+    succ_.clear();
+    pred_.clear();
+    alive_.clear();
+    nodeCount_ = 0;
+    ord_.clear();
+    node_.clear();
+    valid_ = true;
+    condensed_ = false;
+    component_.clear();
+    condensationOrder_.clear();
+    mark_.clear();
+    currentMark_ = 0;
+    downstreamCache_ = ClosureCache();
+    upstreamCache_ = ClosureCache();
+}
+
+bool QDataflowTopology::isAcyclic() const
+{
+    if(!valid_ && !condensed_) updateCondensation();
+    return valid_;
+}
+
+bool QDataflowTopology::wouldCreateCycle(int source, int dest) const
+{
+    if(!contains(source) || !contains(dest)) return false;
+    if(source == dest) return true;
+
+    // only nodes placed before source (or, with cycles, in a component
+    // placed before the component of source) can be on a path from dest
+    // to source:
+    if(!valid_ && !condensed_) updateCondensation();
+    const QVector<int> &ord = valid_ ? ord_ : component_;
+    if(ord[source] < ord[dest]) return false;
+    if(!valid_ && component_[source] == component_[dest]) return true;
+    const int bound = ord[source];
+
+    int mark = nextMark();
+    stack_.clear();
+    stack_.push_back(dest);
+    mark_[dest] = mark;
+    while(!stack_.isEmpty())
+    {
+        int n = stack_.back();
+        stack_.pop_back();
+        foreach(int w, succ_[n])
+        {
+            if(w == source) {stack_.clear(); return true;}
+            if(mark_[w] == mark || ord[w] > bound) continue;
+            mark_[w] = mark;
+            stack_.push_back(w);
+        }
+    }
+    return false;
+}
+
+QVector<int> QDataflowTopology::order() const
+{
+    if(!valid_ && !condensed_) updateCondensation();
+    if(!valid_) return condensationOrder_;
+
+    QVector<int> ret;
+    ret.reserve(nodeCount_);
+    foreach(int n, node_)
+        if(n >= 0) ret.push_back(n);
+    return ret;
+}
+
+QList<QVector<int> > QDataflowTopology::stronglyConnectedComponents() const
+{
+    // iterative Tarjan's algorithm; components are found in reverse
+    // topological order of the condensation
+    QList<QVector<int> > ret;
+    const int n = succ_.size();
+    QVector<int> index(n, -1), low(n, 0);
+    QVector<bool> onStack(n, false);
+    QVector<int> component;
+    QVector<QPair<int, int> > frames;
+    int counter = 0;
+
+    for(int root = 0; root < n; root++)
+    {
+        if(!alive_[root] || index[root] != -1) continue;
+
+        frames.push_back(qMakePair(root, 0));
+        index[root] = low[root] = counter++;
+        component.push_back(root);
+        onStack[root] = true;
+
+        while(!frames.isEmpty())
+        {
+            int v = frames.back().first;
+            int &i = frames.back().second;
+            if(i < succ_[v].size())
+            {
+                int w = succ_[v].at(i++);
+                if(index[w] == -1)
+                {
+                    index[w] = low[w] = counter++;
+                    component.push_back(w);
+                    onStack[w] = true;
+                    frames.push_back(qMakePair(w, 0));
+                }
+                else if(onStack[w])
+                {
+                    low[v] = qMin(low[v], index[w]);
+                }
+                continue;
+            }
+
+            frames.pop_back();
+            if(!frames.isEmpty())
+            {
+                int parent = frames.back().first;
+                low[parent] = qMin(low[parent], low[v]);
+            }
+            if(low[v] == index[v])
+            {
+                QVector<int> scc;
+                int w;
+                do
+                {
+                    w = component.back();
+                    component.pop_back();
+                    onStack[w] = false;
+                    scc.push_back(w);
+                }
+                while(w != v);
+                std::sort(scc.begin(), scc.end());
+                ret.push_front(scc);
+            }
+        }
+    }
+    return ret;
+}
+
+QBitArray QDataflowTopology::downstream(int id) const
+{
+    return closure(id, true);
+}
+
+QBitArray QDataflowTopology::upstream(int id) const
+{
+    return closure(id, false);
+}
+
+QBitArray QDataflowTopology::downstream(const QVector<int> &ids) const
+{
+    return closure(ids, true);
+}
+
+QBitArray QDataflowTopology::upstream(const QVector<int> &ids) const
+{
+    return closure(ids, false);
+}
+
+bool QDataflowTopology::isReachable(int source, int dest) const
+{
+    if(!contains(source) || !contains(dest)) return false;
+    const ClosureCache &cache = downstreamCache_;
+    if(source == dest || (source < cache.closures.size() && !cache.closures.at(source).isEmpty()))
+        return downstream(source).testBit(dest);
+    // a path source -> dest exists iff an edge dest -> source closes a cycle:
+    return wouldCreateCycle(dest, source);
+}
+
+bool QDataflowTopology::contains(int id) const
+{
+    return id >= 0 && id < alive_.size() && alive_[id];
+}
+
+QBitArray QDataflowTopology::closure(int id, bool forward) const
+{
+    if(!contains(id)) return QBitArray(succ_.size());
+    ClosureCache &cache = forward ? downstreamCache_ : upstreamCache_;
+    if(id < cache.closures.size() && !cache.closures.at(id).isEmpty())
+        return cache.closures.at(id);
+    QBitArray ret = computeClosure(id, forward);
+    store(cache, id, ret);
+    return ret;
+}
+
+QBitArray QDataflowTopology::closure(const QVector<int> &ids, bool forward) const
+{
+    ClosureCache &cache = forward ? downstreamCache_ : upstreamCache_;
+    QBitArray ret(succ_.size());
+    QBitArray seen(succ_.size());
+    QVector<int> missing;
+    foreach(int id, ids)
+    {
+        if(!contains(id) || seen.testBit(id)) continue;
+        seen.setBit(id);
+        if(id < cache.closures.size() && !cache.closures.at(id).isEmpty())
+            ret |= cache.closures.at(id);
+        else
+            missing.push_back(id);
+    }
+
+    // cold closures are independent of each other: compute them in parallel
+    // (the graph is not modified meanwhile), and cache them afterwards
+    QVector<QBitArray> computed;
+    if(missing.size() > 1)
+    {
+        ClosureFunctor functor;
+        functor.topology = this;
+        functor.forward = forward;
+        computed = QtConcurrent::blockingMapped<QVector<QBitArray> >(missing, functor);
+    }
+    else if(missing.size() == 1)
+        computed.push_back(computeClosure(missing.first(), forward));
+
+    for(int i = 0; i < missing.size(); i++)
+    {
+        store(cache, missing.at(i), computed.at(i));
+        ret |= computed.at(i);
+    }
+    return ret;
+}
+
+QBitArray QDataflowTopology::computeClosure(int id, bool forward) const
+{
+    // must not touch the shared scratch space, as it runs concurrently
+    const QVector<QVector<int> > &adj = forward ? succ_ : pred_;
+    QBitArray ret(adj.size());
+    QVector<int> stack;
+    stack.push_back(id);
+    while(!stack.isEmpty())
+    {
+        int n = stack.back();
+        stack.pop_back();
+        foreach(int w, adj.at(n))
+        {
+            if(ret.testBit(w)) continue;
+            ret.setBit(w);
+            stack.push_back(w);
+        }
+    }
+    return ret;
+}
+
+void QDataflowTopology::store(ClosureCache &cache, int id, const QBitArray &closure) const
+{
+    const qint64 bytes = (closure.size() + 7) / 8;
+    if(cache.bytes + bytes > MaxCachedBytes)
+        cache = ClosureCache();
+    if(cache.closures.size() <= id)
+        cache.closures.resize(succ_.size());
+    cache.closures[id] = closure;
+    cache.ids.push_back(id);
+    cache.bytes += bytes;
+}
+
+void QDataflowTopology::invalidate(ClosureCache &cache, int id) const
+{
+    // drop the closures of the nodes that reach id (resp. are reached from
+    // id, for the upstream cache), and the closure of id itself
+    for(int i = 0; i < cache.ids.size(); )
+    {
+        int n = cache.ids.at(i);
+        QBitArray &c = cache.closures[n];
+        if(n == id || (id < c.size() && c.testBit(id)))
+        {
+            cache.bytes -= (c.size() + 7) / 8;
+            c = QBitArray();
+            cache.ids[i] = cache.ids.back();
+            cache.ids.pop_back();
+        }
+        else i++;
+    }
+}
+
+void QDataflowTopology::updateOrder() const
+{
+    // Kahn's algorithm, visiting nodes in their previous order so that
+    // the new order stays close to it
+    QVector<int> indegree(succ_.size(), 0);
+    QVector<int> queue;
+    queue.reserve(nodeCount_);
+    foreach(int n, node_)
+    {
+        if(n < 0) continue;
+        indegree[n] = pred_[n].size();
+        if(indegree[n] == 0) queue.push_back(n);
+    }
+    for(int head = 0; head < queue.size(); head++)
+    {
+        foreach(int w, succ_[queue[head]])
+            if(--indegree[w] == 0) queue.push_back(w);
+    }
+    if(queue.size() < nodeCount_) return;
+
+    node_ = queue;
+    for(int i = 0; i < node_.size(); i++)
+        ord_[node_[i]] = i;
+    valid_ = true;
+}
+
+void QDataflowTopology::updateCondensation() const
+{
+    const QList<QVector<int> > components = stronglyConnectedComponents();
+    component_.fill(-1, succ_.size());
+    condensationOrder_.clear();
+    condensationOrder_.reserve(nodeCount_);
+    componentCount_ = 0;
+    bool cyclic = false;
+    foreach(const QVector<int> &component, components)
+    {
+        if(component.size() > 1 || succ_[component.first()].contains(component.first()))
+            cyclic = true;
+        foreach(int n, component)
+            component_[n] = componentCount_;
+        componentCount_++;
+        condensationOrder_ += component;
+    }
+
+    if(cyclic)
+    {
+        condensed_ = true;
+        return;
+    }
+
+    // no cycles left: the order of the condensation is a topological order
+    node_ = condensationOrder_;
+    for(int i = 0; i < node_.size(); i++)
+        ord_[node_[i]] = i;
+    valid_ = true;
+    condensed_ = false;
+    condensationOrder_.clear();
+    component_.clear();
+}
+
+void QDataflowTopology::compact() const
+{
+    QVector<int> nodes;
+    nodes.reserve(nodeCount_);
+    foreach(int n, node_)
+        if(n >= 0) nodes.push_back(n);
+    node_ = nodes;
+    for(int i = 0; i < node_.size(); i++)
+        ord_[node_[i]] = i;
+}
+
+int QDataflowTopology::nextMark() const
+{
+    if(++currentMark_ == std::numeric_limits<int>::max())
+    {
+        mark_.fill(0);
+        currentMark_ = 1;
+    }
+    return currentMark_;
+}
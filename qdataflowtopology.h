@@ -0,0 +1,129 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWTOPOLOGY_H
+#define QDATAFLOWTOPOLOGY_H
+
+#include <QBitArray>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+// Node-level graph of a QDataflowModel (vertices are node IDs), keeping a
+// topological order up to date as edges are added and removed, with the
+// dynamic algorithm of Pearce and Kelly: adding an edge only reorders the
+// nodes whose position lies between its endpoints.
+//
+// Parallel connections between the same two nodes are counted as multiple
+// edges. When an edge closes a cycle, the order is replaced by an order of
+// the condensation (strongly connected components in topological order),
+// computed on demand and kept as long as edge changes don't affect it:
+// edges going forward between components, or within a component, and
+// removals of edges between components leave it as it is. It is what
+// order() returns while the graph has cycles, and it bounds the searches
+// of wouldCreateCycle() the same way the order does; once the graph is
+// acyclic again, it becomes the order.
+//
+// Reachability closures (the set of nodes downstream or upstream of a node,
+// as a bit array indexed by node ID) are cached, and an edge change only
+// invalidates the cached closures that contain one of its endpoints.
+// Closures which are not cached are computed in parallel when queried
+// in batch.
+class QDataflowTopology
+{
+public:
+    QDataflowTopology();
+
+    void addNode(int id);
+    void removeNode(int id);
+    void addEdge(int source, int dest);
+    // many edges at once: the order is recomputed in one pass instead
+    void addEdges(const QVector<QPair<int, int> > &edges);
+    void removeEdge(int source, int dest);
+    void clear();
+
+    bool isAcyclic() const;
+    bool wouldCreateCycle(int source, int dest) const;
+    QVector<int> order() const;
+    QList<QVector<int> > stronglyConnectedComponents() const;
+
+    QBitArray downstream(int id) const;
+    QBitArray upstream(int id) const;
+    QBitArray downstream(const QVector<int> &ids) const;
+    QBitArray upstream(const QVector<int> &ids) const;
+    bool isReachable(int source, int dest) const;
+
+    // cache limit, in bytes of closures per direction: a closure takes one
+    // bit per node, so the number of closures kept shrinks as the graph grows
+    enum {MaxCachedBytes = 16 * 1024 * 1024};
+
+private:
+    struct ClosureCache
+    {
+        ClosureCache() : bytes(0) {}
+
+        QVector<QBitArray> closures;
+        QVector<int> ids;
+        qint64 bytes;
+    };
+
+    struct ClosureFunctor
+    {
+        typedef QBitArray result_type;
+        const QDataflowTopology *topology;
+        bool forward;
+        QBitArray operator()(int id) const {return topology->computeClosure(id, forward);}
+    };
+
+    bool contains(int id) const;
+    QBitArray closure(int id, bool forward) const;
+    QBitArray closure(const QVector<int> &ids, bool forward) const;
+    QBitArray computeClosure(int id, bool forward) const;
+    void store(ClosureCache &cache, int id, const QBitArray &closure) const;
+    void invalidate(ClosureCache &cache, int id) const;
+    void updateOrder() const;
+    void updateCondensation() const;
+    void compact() const;
+    int nextMark() const;
+
+    QVector<QVector<int> > succ_;
+    QVector<QVector<int> > pred_;
+    QVector<bool> alive_;
+    int nodeCount_;
+
+    // ord_[id] is the position of node id; node_[pos] is the node at
+    // position pos, or -1 for the positions left by removed nodes
+    mutable QVector<int> ord_;
+    mutable QVector<int> node_;
+    mutable bool valid_;
+
+    // while !valid_: position of the component of each node in the order
+    // of the condensation, and the nodes in that order (if condensed_)
+    mutable bool condensed_;
+    mutable QVector<int> component_;
+    mutable QVector<int> condensationOrder_;
+    mutable int componentCount_;
+
+    // scratch space for the searches, reset by bumping the mark
+    mutable QVector<int> mark_;
+    mutable int currentMark_;
+    mutable QVector<int> stack_;
+
+    mutable ClosureCache downstreamCache_;
+    mutable ClosureCache upstreamCache_;
+};
+
+#endif // QDATAFLOWTOPOLOGY_H
@@ -0,0 +1,148 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowtyperegistry.h"
+
+QDataflowTypeRegistry::Matrix::Matrix(int capacity)
+    : capacity(capacity), stride((capacity + 31) / 32), bits(new QAtomicInteger<quint32>[capacity * stride])
+{
+}
+
+QDataflowTypeRegistry::Matrix::~Matrix()
+{
+    delete [] bits;
+}
+
+bool QDataflowTypeRegistry::Matrix::testBit(int row, int column) const
+{
+    return bits[row * stride + column / 32].loadAcquire() & (1u << (column % 32));
+}
+
+void QDataflowTypeRegistry::Matrix::setBit(int row, int column)
+{
+    bits[row * stride + column / 32].fetchAndOrRelease(1u << (column % 32));
+}
+
+QDataflowTypeRegistry::QDataflowTypeRegistry()
+    : matrix_(0L), count_(0)
+{
+    ids_.insert("*", Wildcard);
+    names_ << "*";
+    reserve(1)->setBit(Wildcard, Wildcard);
+    count_.storeRelease(1);
+}
+
+QDataflowTypeRegistry::~QDataflowTypeRegistry()
+{
+    delete matrix_.load();
+    qDeleteAll(retired_);
+}
+
+QDataflowTypeRegistry * QDataflowTypeRegistry::instance()
+{
+    static QDataflowTypeRegistry registry;
+    return &registry;
+}
+
+int QDataflowTypeRegistry::intern(const QString &name)
+{
+    {
+        QReadLocker locker(&lock_);
+        QHash<QString, int>::const_iterator it = ids_.constFind(name);
+        if(it != ids_.constEnd()) return it.value();
+    }
+
+    QWriteLocker locker(&lock_);
+    QHash<QString, int>::const_iterator it = ids_.constFind(name);
+    if(it != ids_.constEnd()) return it.value();
+    int type = names_.size();
+    ids_.insert(name, type);
+    names_ << name;
+    // a new type is only compatible with itself
+    reserve(type + 1)->setBit(type, type);
+    count_.storeRelease(type + 1);
+    return type;
+}
+
+QString QDataflowTypeRegistry::name(int type) const
+{
+    QReadLocker locker(&lock_);
+    return names_.value(type);
+}
+
+int QDataflowTypeRegistry::count() const
+{
+    QReadLocker locker(&lock_);
+    return names_.size();
+}
+
+void QDataflowTypeRegistry::addSupertype(int type, int supertype)
+{
+    QWriteLocker locker(&lock_);
+    const int n = names_.size();
+    if(type < 0 || type >= n || supertype < 0 || supertype >= n) return;
+    Matrix *matrix = matrix_.load();
+    if(matrix->testBit(type, supertype)) return;
+
+    // the rows are transitively closed: whatever reaches type (including
+    // type itself) now reaches everything supertype reaches as well
+    for(int r = 0; r < n; r++)
+    {
+        if(!matrix->testBit(r, type)) continue;
+        for(int w = 0; w < matrix->stride; w++)
+        {
+            quint32 word = matrix->bits[supertype * matrix->stride + w].loadAcquire();
+            if(word) matrix->bits[r * matrix->stride + w].fetchAndOrRelease(word);
+        }
+    }
+}
+
+void QDataflowTypeRegistry::addSupertype(const QString &type, const QString &supertype)
+{
+    addSupertype(intern(type), intern(supertype));
+}
+
+bool QDataflowTypeRegistry::isCompatible(int outletType, int inletType) const
+{
+    if(inletType == Wildcard) return true;
+    if(outletType == inletType) return true;
+
+    // count_ is published after the matrix holding its rows
+    const int n = count_.loadAcquire();
+    if(outletType < 0 || inletType < 0 || outletType >= n || inletType >= n) return false;
+    return matrix_.loadAcquire()->testBit(outletType, inletType);
+}
+
+QDataflowTypeRegistry::Matrix * QDataflowTypeRegistry::reserve(int count)
+{
+    // called with the write lock held (or from the constructor)
+    Matrix *old = matrix_.load();
+    if(old && old->capacity >= count) return old;
+
+    int capacity = old ? old->capacity : 64;
+    while(capacity < count) capacity *= 2;
+    Matrix *matrix = new Matrix(capacity);
+    if(old)
+    {
+        const int n = count_.load();
+        for(int r = 0; r < n; r++)
+            for(int w = 0; w < old->stride; w++)
+                matrix->bits[r * matrix->stride + w].store(old->bits[r * old->stride + w].load());
+        retired_.push_back(old);
+    }
+    matrix_.storeRelease(matrix);
+    return matrix;
+}
@@ -0,0 +1,86 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWTYPEREGISTRY_H
+#define QDATAFLOWTYPEREGISTRY_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QReadWriteLock>
+
+// Interns port type names to small integers, and keeps a compatibility
+// bit matrix: row t has bit u set if an outlet of type t can be connected
+// to an inlet of type u (i.e. t is u, or t is a subtype of u).
+// An inlet of type "*" (Wildcard) accepts anything.
+// Types are interned at any time (e.g. by setInletTypes() or by the patch
+// loaders), from any thread. The matrix is updated in place, one bit (or
+// one closure row) at a time; bits are only ever set, so isCompatible()
+// reads it without locking.
+class QDataflowTypeRegistry
+{
+public:
+    enum {Wildcard = 0};
+
+    static QDataflowTypeRegistry * instance();
+
+    int intern(const QString &name);
+    QString name(int type) const;
+    int count() const;
+
+    void addSupertype(int type, int supertype);
+    void addSupertype(const QString &type, const QString &supertype);
+
+    bool isCompatible(int outletType, int inletType) const;
+
+private:
+    // capacity x capacity bits, in rows of stride words
+    struct Matrix
+    {
+        explicit Matrix(int capacity);
+        ~Matrix();
+
+        bool testBit(int row, int column) const;
+        void setBit(int row, int column);
+
+        int capacity;
+        int stride;
+        QAtomicInteger<quint32> *bits;
+    };
+
+    QDataflowTypeRegistry();
+    ~QDataflowTypeRegistry();
+    Q_DISABLE_COPY(QDataflowTypeRegistry)
+
+    Matrix * reserve(int count);
+
+    mutable QReadWriteLock lock_;
+    QHash<QString, int> ids_;
+    QStringList names_;
+    QAtomicPointer<Matrix> matrix_;
+    // number of rows of matrix_ in use; published after them
+    QAtomicInt count_;
+    // outgrown matrices, which readers may still be using: the capacity
+    // doubles each time, so together they are smaller than matrix_
+    QList<Matrix*> retired_;
+};
+
+#endif // QDATAFLOWTYPEREGISTRY_H
@@ -0,0 +1,461 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "qdataflowundojournal.h"
+#include "qdataflowmodel.h"
+#include "qdataflowsubpatch.h"
+#include "qdataflowtyperegistry.h"
+
+QDataflowUndoJournal::QDataflowUndoJournal(QDataflowModel *model)
+    : QObject(model), model_(model), index_(0), limit_(1000), depth_(0),
+      portsDepth_(0), replaying_(false), sealed_(true)
+{
+    QDataflowUndoJournal *old = model->undoJournal_;
+    model->undoJournal_ = this;
+    delete old;
+}
+
+QDataflowUndoJournal::~QDataflowUndoJournal()
+{
+    if(model_->undoJournal_ == this)
+        model_->undoJournal_ = 0L;
+}
+
+QDataflowModel * QDataflowUndoJournal::model() const
+{
+    return model_;
+}
+
+bool QDataflowUndoJournal::canUndo() const
+{
+    return index_ > 0;
+}
+
+bool QDataflowUndoJournal::canRedo() const
+{
+    return index_ < commands_.size();
+}
+
+int QDataflowUndoJournal::count() const
+{
+    return commands_.size();
+}
+
+int QDataflowUndoJournal::index() const
+{
+    return index_;
+}
+
+int QDataflowUndoJournal::limit() const
+{
+    return limit_;
+}
+
+void QDataflowUndoJournal::setLimit(int limit)
+{
+    limit_ = qMax(1, limit);
+    if(depth_ == 0 && commands_.size() > limit_)
+    {
+        dropOldest();
+        emit changed();
+    }
+}
+
+qint64 QDataflowUndoJournal::memoryUsage() const
+{
+    qint64 ret = commands_.size() * sizeof(Command);
+    foreach(const Command &command, commands_)
+    {
+        ret += command.deltas.capacity() * sizeof(Delta);
+        foreach(const Delta &delta, command.deltas)
+            ret += delta.types.capacity() * sizeof(int);
+    }
+    foreach(const QString &text, texts_)
+        ret += text.capacity() * sizeof(QChar);
+    foreach(const QByteArray &contents, subpatchContents_)
+        ret += contents.capacity();
+    return ret;
+}
+
+void QDataflowUndoJournal::undo()
+{
+    if(!canUndo() || depth_ > 0) return;
+    Command &command = commands_[--index_];
+
+    replaying_ = true;
+    {
+        QDataflowModelUpdateGuard guard(model_);
+        for(int i = command.deltas.size() - 1; i >= 0; i--)
+            apply(command.deltas[i], false);
+    }
+    replaying_ = false;
+
+    sealed_ = true;
+    emit changed();
+}
+
+void QDataflowUndoJournal::redo()
+{
+    if(!canRedo() || depth_ > 0) return;
+    Command &command = commands_[index_++];
+
+    replaying_ = true;
+    {
+        QDataflowModelUpdateGuard guard(model_);
+        for(int i = 0; i < command.deltas.size(); i++)
+            apply(command.deltas[i], true);
+    }
+    replaying_ = false;
+
+    sealed_ = true;
+    emit changed();
+}
+
+void QDataflowUndoJournal::seal()
+{
+    sealed_ = true;
+}
+
+void QDataflowUndoJournal::clear()
+{
+    if(depth_ > 0) return;
+    commands_.clear();
+    pending_.clear();
+    index_ = 0;
+    textIds_.clear();
+    texts_.clear();
+    textRefs_.clear();
+    freeTexts_.clear();
+    subpatchContents_.clear();
+    nodeStates_.clear();
+    sealed_ = true;
+    emit changed();
+}
+
+void QDataflowUndoJournal::beginCommand()
+{
+    if(replaying_) return;
+    if(depth_++ > 0) return;
+    pending_.clear();
+}
+
+void QDataflowUndoJournal::endCommand()
+{
+    if(replaying_) return;
+    if(--depth_ > 0) return;
+    if(pending_.isEmpty()) return;
+
+    bool moves = true;
+    for(int i = 0; i < pending_.size() && moves; i++)
+        moves = pending_.at(i).kind == NodeMoved;
+
+    if(moves && !sealed_ && index_ > 0 && commands_.last().moves)
+    {
+        mergeMoves();
+    }
+    else
+    {
+        Command command;
+        command.deltas = pending_;
+        command.moves = moves;
+        commands_.push_back(command);
+        index_++;
+        sealed_ = !moves;
+        if(commands_.size() > limit_ + limit_ / 8)
+            dropOldest();
+    }
+    pending_.clear();
+    emit changed();
+}
+
+void QDataflowUndoJournal::record(const Delta &delta)
+{
+    if(replaying_) return;
+
+    bool standalone = depth_ == 0;
+    if(standalone) beginCommand();
+
+    // counted first: the commands discarded below may refer to the same node
+    if(delta.kind == NodeCreated || delta.kind == NodeRemoved)
+        nodeStates_[delta.id]++;
+    if(index_ < commands_.size())
+    {
+        // a new command discards the commands that have been undone
+        dropCommands(index_, commands_.size() - index_);
+        sealed_ = true;
+    }
+    pending_.push_back(delta);
+
+    if(standalone) endCommand();
+}
+
+void QDataflowUndoJournal::recordNodeCreated(QDataflowModelNode *node)
+{
+    Delta delta = {NodeCreated, node->id(), 0, 0, -1, 0, QVector<int>()};
+    record(delta);
+}
+
+void QDataflowUndoJournal::recordNodeRemoved(QDataflowModelNode *node)
+{
+    if(replaying_) return;
+    Delta delta = {NodeRemoved, node->id(), 0, 0, -1, 0, QVector<int>()};
+    captureNode(delta, node);
+    record(delta);
+}
+
+void QDataflowUndoJournal::recordConnectionAdded(QDataflowModelConnection *conn)
+{
+    Delta delta = {ConnectionAdded, conn->id(),
+                   conn->source().node()->id(), conn->source().index(),
+                   conn->dest().node()->id(), conn->dest().index(), QVector<int>()};
+    record(delta);
+}
+
+void QDataflowUndoJournal::recordConnectionRemoved(QDataflowModelConnection *conn)
+{
+    Delta delta = {ConnectionRemoved, conn->id(),
+                   conn->source().node()->id(), conn->source().index(),
+                   conn->dest().node()->id(), conn->dest().index(), QVector<int>()};
+    record(delta);
+}
+
+void QDataflowUndoJournal::recordNodeMoved(QDataflowModelNode *node, QPoint oldPos)
+{
+    Delta delta = {NodeMoved, node->id(), oldPos.x(), oldPos.y(), node->pos().x(), node->pos().y(), QVector<int>()};
+    record(delta);
+}
+
+void QDataflowUndoJournal::recordNodeTextChanged(QDataflowModelNode *node, const QString &oldText)
+{
+    if(replaying_) return;
+    Delta delta = {NodeTextChanged, node->id(), internText(oldText), internText(node->text()), 0, 0, QVector<int>()};
+    record(delta);
+}
+
+void QDataflowUndoJournal::recordPortsChanged(QDataflowModelNode *node, bool inlets, const QVector<int> &oldTypes)
+{
+    if(replaying_) return;
+    QVector<int> newTypes = inlets ? node->inletTypeIds() : node->outletTypeIds();
+    if(newTypes == oldTypes) return;
+    Delta delta = {inlets ? InletsChanged : OutletsChanged, node->id(), oldTypes.size(), 0, 0, 0, oldTypes + newTypes};
+    record(delta);
+}
+
+void QDataflowUndoJournal::captureNode(Delta &delta, QDataflowModelNode *node)
+{
+    delta.a = node->pos().x();
+    delta.b = node->pos().y();
+    const int text = internText(node->text());
+    if(delta.c >= 0) releaseText(delta.c);
+    delta.c = text;
+    delta.d = node->inletCount();
+    delta.types = node->inletTypeIds() + node->outletTypeIds();
+    if(node->subpatch())
+        subpatchContents_.insert(node->id(), node->subpatch()->contents());
+}
+
+void QDataflowUndoJournal::restoreNode(const Delta &delta)
+{
+    QDataflowModelNode *node = model_->restoreNode(delta.id, QPoint(delta.a, delta.b), texts_.at(delta.c),
+                                                   delta.types.mid(0, delta.d), delta.types.mid(delta.d));
+    QHash<int, QByteArray>::const_iterator it = subpatchContents_.constFind(delta.id);
+    if(node && it != subpatchContents_.constEnd())
+        node->makeSubpatch()->setContents(it.value());
+}
+
+void QDataflowUndoJournal::apply(Delta &delta, bool redo)
+{
+    QDataflowModelNode *node = 0L;
+    if(delta.kind != ConnectionAdded && delta.kind != ConnectionRemoved)
+    {
+        node = model_->node(delta.id);
+        if(!node && !((delta.kind == NodeCreated && redo) || (delta.kind == NodeRemoved && !redo)))
+            return;
+    }
+
+    switch(delta.kind)
+    {
+    case NodeCreated:
+    case NodeRemoved:
+        if(redo == (delta.kind == NodeCreated))
+        {
+            restoreNode(delta);
+        }
+        else
+        {
+            // keep the last state, for when the creation is redone
+            if(delta.kind == NodeCreated)
+                captureNode(delta, node);
+            model_->remove(node);
+        }
+        break;
+    case ConnectionAdded:
+    case ConnectionRemoved:
+        if(redo == (delta.kind == ConnectionAdded))
+            model_->restoreConnection(delta.id, model_->node(delta.a), delta.b, model_->node(delta.c), delta.d);
+        else
+            model_->removeConnection(model_->connection(delta.id));
+        break;
+    case NodeMoved:
+        node->setPos(redo ? QPoint(delta.c, delta.d) : QPoint(delta.a, delta.b));
+        break;
+    case NodeTextChanged:
+        node->setText(texts_.at(redo ? delta.b : delta.a));
+        break;
+    case InletsChanged:
+    case OutletsChanged:
+        {
+            QVector<int> types = redo ? delta.types.mid(delta.a) : delta.types.mid(0, delta.a);
+            QStringList names;
+            foreach(int type, types)
+                names << QDataflowTypeRegistry::instance()->name(type);
+            if(delta.kind == InletsChanged)
+                node->setInletTypes(names);
+            else
+                node->setOutletTypes(names);
+        }
+        break;
+    }
+}
+
+void QDataflowUndoJournal::mergeMoves()
+{
+    // merge the moves in pending_ into the last command: a node moved
+    // again keeps its original old position
+    QVector<Delta> &deltas = commands_.last().deltas;
+    QHash<int, int> moved;
+    for(int i = 0; i < deltas.size(); i++)
+        moved.insert(deltas.at(i).id, i);
+    foreach(const Delta &delta, pending_)
+    {
+        QHash<int, int>::const_iterator it = moved.constFind(delta.id);
+        if(it != moved.constEnd())
+        {
+            deltas[it.value()].c = delta.c;
+            deltas[it.value()].d = delta.d;
+        }
+        else
+        {
+            moved.insert(delta.id, deltas.size());
+            deltas.push_back(delta);
+        }
+    }
+}
+
+void QDataflowUndoJournal::dropOldest()
+{
+    int n = commands_.size() - limit_;
+    if(n <= 0) return;
+    dropCommands(0, n);
+    index_ = qMax(0, index_ - n);
+}
+
+void QDataflowUndoJournal::dropCommands(int first, int count)
+{
+    for(int i = first; i < first + count; i++)
+        foreach(const Delta &delta, commands_.at(i).deltas)
+            release(delta);
+    commands_.erase(commands_.begin() + first, commands_.begin() + first + count);
+}
+
+void QDataflowUndoJournal::release(const Delta &delta)
+{
+    switch(delta.kind)
+    {
+    case NodeCreated:
+    case NodeRemoved:
+        {
+            if(delta.c >= 0) releaseText(delta.c);
+            QHash<int, int>::iterator it = nodeStates_.find(delta.id);
+            if(it != nodeStates_.end() && --it.value() == 0)
+            {
+                nodeStates_.erase(it);
+                subpatchContents_.remove(delta.id);
+            }
+        }
+        break;
+    case NodeTextChanged:
+        releaseText(delta.a);
+        releaseText(delta.b);
+        break;
+    }
+}
+
+int QDataflowUndoJournal::internText(const QString &text)
+{
+    // each call adds a reference, released by releaseText()
+    int id;
+    QHash<QString, int>::const_iterator it = textIds_.constFind(text);
+    if(it != textIds_.constEnd())
+    {
+        id = it.value();
+    }
+    else if(!freeTexts_.isEmpty())
+    {
+        id = freeTexts_.back();
+        freeTexts_.pop_back();
+        texts_[id] = text;
+        textIds_.insert(text, id);
+    }
+    else
+    {
+        id = texts_.size();
+        texts_ << text;
+        textRefs_.push_back(0);
+        textIds_.insert(text, id);
+    }
+    textRefs_[id]++;
+    return id;
+}
+
+void QDataflowUndoJournal::releaseText(int id)
+{
+    if(--textRefs_[id] > 0) return;
+    textIds_.remove(texts_.at(id));
+    texts_[id] = QString();
+    freeTexts_.push_back(id);
+}
+
+QDataflowUndoGroup::QDataflowUndoGroup(QDataflowModel *model)
+    : journal_(model ? model->undoJournal() : 0L)
+{
+    if(journal_) journal_->beginCommand();
+}
+
+QDataflowUndoGroup::~QDataflowUndoGroup()
+{
+    if(journal_) journal_->endCommand();
+}
+
+QDataflowUndoPortsGroup::QDataflowUndoPortsGroup(QDataflowModelNode *node, bool inlets)
+    : journal_(node->model() ? node->model()->undoJournal() : 0L), node_(node), inlets_(inlets), outermost_(false)
+{
+    if(!journal_) return;
+    journal_->beginCommand();
+    if(journal_->portsDepth_++ == 0 && node->model()->contains(node))
+    {
+        outermost_ = true;
+        oldTypes_ = inlets ? node->inletTypeIds() : node->outletTypeIds();
+    }
+}
+
+QDataflowUndoPortsGroup::~QDataflowUndoPortsGroup()
+{
+    if(!journal_) return;
+    if(--journal_->portsDepth_ == 0 && outermost_)
+        journal_->recordPortsChanged(node_, inlets_, oldTypes_);
+    journal_->endCommand();
+}
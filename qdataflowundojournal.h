@@ -0,0 +1,193 @@
+/* QDataflowCanvas - a dataflow widget for Qt
+ * Copyright (C) 2017 Federico Ferri
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef QDATAFLOWUNDOJOURNAL_H
+#define QDATAFLOWUNDOJOURNAL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QDataflowModel;
+class QDataflowModelNode;
+class QDataflowModelConnection;
+
+// Undo/redo history of a QDataflowModel. Every change to the model is
+// recorded as a small delta referring to nodes and connections by ID
+// (node texts are pooled, port types are stored interned), and the deltas
+// of a top-level transaction, or of a single model/node call, together with
+// the changes made by receivers of the signals emitted meanwhile, make up
+// one command. Each command keeps its own deltas, so that discarding old
+// (or undone) commands doesn't move the others; the pooled texts and the
+// contents of removed subpatches are reference counted by the deltas, and
+// go with the last one using them.
+//
+// Consecutive commands that only move nodes (e.g. mouse drags) are merged
+// into one, until seal() is called (e.g. on mouse release) or a different
+// command is recorded. Undo and redo replay a command in one transaction.
+class QDataflowUndoJournal : public QObject
+{
+    Q_OBJECT
+public:
+    // the journal attaches itself to the model (replacing any other
+    // journal), and is owned by it
+    explicit QDataflowUndoJournal(QDataflowModel *model);
+    virtual ~QDataflowUndoJournal();
+
+    QDataflowModel * model() const;
+
+    bool canUndo() const;
+    bool canRedo() const;
+    int count() const;
+    int index() const;
+
+    // maximum number of commands kept; older ones are discarded
+    int limit() const;
+    void setLimit(int limit);
+
+    // approximate size of the history, in bytes
+    qint64 memoryUsage() const;
+
+public slots:
+    void undo();
+    void redo();
+    void seal();
+    void clear();
+
+signals:
+    void changed();
+
+private:
+    enum Kind
+    {
+        NodeCreated,
+        NodeRemoved,
+        ConnectionAdded,
+        ConnectionRemoved,
+        NodeMoved,
+        NodeTextChanged,
+        InletsChanged,
+        OutletsChanged
+    };
+
+    // node state (NodeCreated, NodeRemoved): a, b = pos, c = text (-1
+    //     until captured), d = inlet count, types = inlet types followed
+    //     by outlet types (captured when undoing NodeCreated)
+    // connection (ConnectionAdded, ConnectionRemoved): id = connection ID,
+    //     a, b = source node ID and outlet, c, d = dest node ID and inlet
+    // NodeMoved: a, b = old pos, c, d = new pos
+    // NodeTextChanged: a = old text, b = new text
+    // InletsChanged, OutletsChanged: a = old count, types = old types
+    //     followed by new types
+    struct Delta
+    {
+        int kind;
+        int id;
+        int a, b, c, d;
+        QVector<int> types;
+    };
+
+    struct Command
+    {
+        QVector<Delta> deltas;
+        bool moves;
+    };
+
+    void beginCommand();
+    void endCommand();
+    void record(const Delta &delta);
+    void recordNodeCreated(QDataflowModelNode *node);
+    void recordNodeRemoved(QDataflowModelNode *node);
+    void recordConnectionAdded(QDataflowModelConnection *conn);
+    void recordConnectionRemoved(QDataflowModelConnection *conn);
+    void recordNodeMoved(QDataflowModelNode *node, QPoint oldPos);
+    void recordNodeTextChanged(QDataflowModelNode *node, const QString &oldText);
+    void recordPortsChanged(QDataflowModelNode *node, bool inlets, const QVector<int> &oldTypes);
+
+    void captureNode(Delta &delta, QDataflowModelNode *node);
+    void restoreNode(const Delta &delta);
+    void apply(Delta &delta, bool redo);
+    void mergeMoves();
+    void dropOldest();
+    void dropCommands(int first, int count);
+    void release(const Delta &delta);
+    int internText(const QString &text);
+    void releaseText(int id);
+
+    QDataflowModel *model_;
+    QList<Command> commands_;
+    // deltas of the command being recorded
+    QVector<Delta> pending_;
+    int index_;
+    int limit_;
+    int depth_;
+    int portsDepth_;
+    bool replaying_;
+    bool sealed_;
+    QHash<QString, int> textIds_;
+    QStringList texts_;
+    // number of deltas using each text; unused slots are reused
+    QVector<int> textRefs_;
+    QVector<int> freeTexts_;
+    // contents of the removed subpatch nodes, by node ID, and the number
+    // of node state deltas of each node ID
+    QHash<int, QByteArray> subpatchContents_;
+    QHash<int, int> nodeStates_;
+
+    friend class QDataflowModel;
+    friend class QDataflowModelNode;
+    friend class QDataflowUndoGroup;
+    friend class QDataflowUndoPortsGroup;
+};
+
+// Groups the changes made in its scope into one undo command (if the model
+// has an undo journal)
+class QDataflowUndoGroup
+{
+public:
+    explicit QDataflowUndoGroup(QDataflowModel *model);
+    ~QDataflowUndoGroup();
+
+private:
+    Q_DISABLE_COPY(QDataflowUndoGroup)
+
+    QDataflowUndoJournal *journal_;
+};
+
+// Like QDataflowUndoGroup, also recording how the inlets (or outlets) of
+// a node changed between the start and the end of the outermost group
+class QDataflowUndoPortsGroup
+{
+public:
+    QDataflowUndoPortsGroup(QDataflowModelNode *node, bool inlets);
+    ~QDataflowUndoPortsGroup();
+
+private:
+    Q_DISABLE_COPY(QDataflowUndoPortsGroup)
+
+    QDataflowUndoJournal *journal_;
+    QDataflowModelNode *node_;
+    bool inlets_;
+    bool outermost_;
+    QVector<int> oldTypes_;
+};
+
+#endif // QDATAFLOWUNDOJOURNAL_H